@@ -0,0 +1,74 @@
+// Teste de alocação da codificação de leituras do data_colletor. Conta
+// todo operator new do processo, por isso fica em um binário próprio e não
+// no coletor nem nos benchmarks. Compilar e rodar a partir de TPF/:
+//   g++ -std=c++17 -O2 bench/collector_alloc_test.cpp -o collector_alloc_test -lpaho-mqttpp3 -lpaho-mqtt3as -lcurl -lpthread
+//   ./collector_alloc_test [quantidade]   (sai com 1 se a codificação alocar)
+#define DATA_COLLECTOR_NO_MAIN
+#include "../data_colletor.cpp"
+#include <new>
+
+// O GCC não sabe que o operator delete abaixo casa com o operator new
+// substituído e acusa free() sobre memória de new
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+
+// Alocações feitas pelo processo inteiro. O operator new substituído só
+// existe neste binário de teste.
+std::atomic<uint64_t> allocationCount(0);
+
+void* operator new(std::size_t size) {
+    allocationCount.fetch_add(1, std::memory_order_relaxed);
+    if (void* ptr = std::malloc(size ? size : 1)) {
+        return ptr;
+    }
+    throw std::bad_alloc();
+}
+
+void* operator new[](std::size_t size) {
+    return operator new(size);
+}
+
+void operator delete(void* ptr) noexcept {
+    std::free(ptr);
+}
+
+void operator delete[](void* ptr) noexcept {
+    operator delete(ptr);
+}
+
+void operator delete(void* ptr, std::size_t) noexcept {
+    operator delete(ptr);
+}
+
+void operator delete[](void* ptr, std::size_t) noexcept {
+    operator delete(ptr);
+}
+
+// Confere que codificar uma leitura (JSON compacto e CBOR) não aloca depois
+// do aquecimento; retorna 1 se alguma alocação for contada. Não cobre o
+// caminho de publicação (AsyncPublisher), que aloca por mensagem.
+int testEncodeAllocations(int messages) {
+    const Timestamp timestamp = currentTimestamp();
+    ReadingSerializer serializer;
+    uint8_t buffer[CBOR_READING_MAX_BYTES];
+    size_t bytes = serializer.serialize(timestamp, 20.79f).size(); // aquece strftime/locale
+
+    uint64_t before = allocationCount.load(std::memory_order_relaxed);
+    for (int i = 0; i < messages; i++) {
+        bytes += serializer.serialize(timestamp + i * NANOS_PER_SECOND, 20.79f + (i & 7)).size();
+        bytes += encodeReadingCBOR(buffer, sizeof(buffer), timestamp + i, 20.79f + (i & 7));
+    }
+    uint64_t allocations = allocationCount.load(std::memory_order_relaxed) - before;
+
+    std::cout << "encode allocations: " << allocations << " in " << messages << " msgs ("
+              << bytes << " bytes)" << std::endl;
+    if (allocations != 0) {
+        std::cerr << "FAIL: reading serialization allocated" << std::endl;
+        return 1;
+    }
+    std::cout << "OK" << std::endl;
+    return 0;
+}
+
+int main(int argc, char* argv[]) {
+    return testEncodeAllocations(argc > 1 ? std::atoi(argv[1]) : 100000);
+}
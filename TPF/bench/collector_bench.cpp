@@ -0,0 +1,202 @@
+// Benchmarks do data_colletor. Ficam fora do binário de produção: este
+// arquivo compila o coletor inteiro sem o main dele e acrescenta os
+// benchmarks. Compilar a partir de TPF/:
+//   g++ -std=c++17 -O2 bench/collector_bench.cpp -o collector_bench -lpaho-mqttpp3 -lpaho-mqtt3as -lcurl -lpthread
+// Uso: ./collector_bench --bench-<nome> [quantidade]
+// keepalive e multipoll precisam do servidor local (bench/weather_stub.py):
+//   python3 bench/weather_stub.py &
+//   ./collector_bench --bench-keepalive http://127.0.0.1:8099/weather 500
+//   python3 bench/weather_stub.py --port 8100 --delay 0.5 &
+//   ./collector_bench --bench-multipoll http://127.0.0.1:8100/weather 500
+#define DATA_COLLECTOR_NO_MAIN
+#include "../data_colletor.cpp"
+
+// Benchmark da codificação de uma leitura: montando a árvore JSON (como o
+// código fazia antes), o ReadingSerializer e o CBOR
+int benchmarkEncode(int messages) {
+    const Timestamp timestamp = currentTimestamp();
+    size_t jsonBytes = 0;
+    size_t cborBytes = 0;
+
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < messages; i++) {
+        json msg;
+        msg["timestamp"] = formatTimestamp(timestamp + i);
+        msg["value"] = 20.79f + (i & 7);
+        jsonBytes += msg.dump(1, '\t').size();
+    }
+    auto middle = std::chrono::steady_clock::now();
+    for (int i = 0; i < messages; i++) {
+        uint8_t buffer[CBOR_READING_MAX_BYTES];
+        cborBytes += encodeReadingCBOR(buffer, sizeof(buffer), timestamp + i, 20.79f + (i & 7));
+    }
+    auto end = std::chrono::steady_clock::now();
+    ReadingSerializer serializer;
+    size_t compactBytes = 0;
+    for (int i = 0; i < messages; i++) {
+        compactBytes += serializer.serialize(timestamp + i, 20.79f + (i & 7)).size();
+    }
+    auto compactEnd = std::chrono::steady_clock::now();
+
+    double jsonSeconds = std::chrono::duration<double>(middle - start).count();
+    double cborSeconds = std::chrono::duration<double>(end - middle).count();
+    double compactSeconds = std::chrono::duration<double>(compactEnd - end).count();
+    std::cout << "encode json: " << (double)jsonBytes / messages << " bytes, "
+              << jsonSeconds * 1e9 / messages << " ns/msg" << std::endl;
+    std::cout << "encode json compacto: " << (double)compactBytes / messages << " bytes, "
+              << compactSeconds * 1e9 / messages << " ns/msg" << std::endl;
+    std::cout << "encode cbor: " << (double)cborBytes / messages << " bytes, "
+              << cborSeconds * 1e9 / messages << " ns/msg" << std::endl;
+    return 0;
+}
+
+// Benchmark da extração de main.temp/main.humidity de uma resposta típica
+// da API: o parser incremental, alimentado em pedaços como pela libcurl,
+// contra juntar o corpo e montar a árvore completa (json::parse)
+int benchmarkWeatherParse(int messages) {
+    const std::string response =
+        "{\"coord\":{\"lon\":-43.9378,\"lat\":-19.9208},\"weather\":[{\"id\":803,"
+        "\"main\":\"Clouds\",\"description\":\"broken clouds\",\"icon\":\"04d\"}],"
+        "\"base\":\"stations\",\"main\":{\"temp\":296.37,\"feels_like\":296.36,\"temp_min\":295.49,"
+        "\"temp_max\":297.13,\"pressure\":1015,\"humidity\":64,\"sea_level\":1015,"
+        "\"grnd_level\":918},\"visibility\":10000,\"wind\":{\"speed\":3.6,\"deg\":90},"
+        "\"clouds\":{\"all\":75},\"dt\":1706662800,\"sys\":{\"type\":2,\"id\":2000456,"
+        "\"country\":\"BR\",\"sunrise\":1706690000,\"sunset\":1706737000},\"timezone\":-10800,"
+        "\"id\":3470127,\"name\":\"Belo Horizonte\",\"cod\":200}";
+    double checksum = 0.0;
+    const size_t chunk = 64;
+    WeatherStreamParser parser;
+
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < messages; i++) {
+        parser.reset();
+        for (size_t pos = 0; pos < response.size(); pos += chunk) {
+            WriteCallback((void*)(response.data() + pos), 1, std::min(chunk, response.size() - pos), &parser);
+        }
+        checksum += parser.temperature + parser.humidity;
+    }
+    auto middle = std::chrono::steady_clock::now();
+    for (int i = 0; i < messages; i++) {
+        std::string body;
+        for (size_t pos = 0; pos < response.size(); pos += chunk) {
+            body.append(response, pos, chunk);
+        }
+        json root = json::parse(body);
+        checksum += root["main"]["temp"].get<float>() + root["main"]["humidity"].get<float>();
+    }
+    auto end = std::chrono::steady_clock::now();
+
+    double streamSeconds = std::chrono::duration<double>(middle - start).count();
+    double domSeconds = std::chrono::duration<double>(end - middle).count();
+    std::cout << "parse stream: " << (size_t)(messages / streamSeconds) << " msgs/s (" << response.size() << " bytes)" << std::endl;
+    std::cout << "parse dom: " << (size_t)(messages / domSeconds) << " msgs/s" << std::endl;
+    std::cout << "(checksum " << checksum << ")" << std::endl;
+    return 0;
+}
+
+// Benchmark do HttpClient contra o servidor local (bench/weather_stub.py):
+// polls requisições alternando entre cinco cidades no mesmo handle. A
+// libcurl informa quantas conexões TCP cada requisição precisou abrir;
+// com keep-alive deve ser uma só no total.
+int benchmarkKeepAlive(const std::string& apiUrl, int polls) {
+    const char* cities[] = {"Belo Horizonte", "Calama", "Sidney", "Beijing", "London"};
+    const char* countries[] = {"BR", "CL", "AUS", "CN", "GB"};
+    std::vector<std::string> urls;
+    for (int i = 0; i < 5; i++) {
+        char* city = curl_easy_escape(nullptr, cities[i], 0);
+        urls.push_back(weatherUrl(apiUrl, WEATHER_API_KEY, city, countries[i]));
+        curl_free(city);
+    }
+
+    HttpClient client;
+    int succeeded = 0;
+    long connections = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < polls; i++) {
+        if (client.get(urls[i % urls.size()])) {
+            succeeded++;
+        }
+        long opened = 0;
+        curl_easy_getinfo(client.handle(), CURLINFO_NUM_CONNECTS, &opened);
+        connections += opened;
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::cout << "keepalive: " << succeeded << " of " << polls << " polls ok, "
+              << connections << " TCP connection(s) opened, " << seconds << " s" << std::endl;
+    return succeeded == polls ? 0 : 1;
+}
+
+// Benchmark de um ciclo de consultas concorrentes contra o servidor local
+// com latência (weather_stub.py --delay 0.5): todas as fontes disparam de
+// uma vez e mede-se o tempo até a última responder. O MultiPoller espalha
+// os disparos ao longo do período, então o ciclo é montado aqui com os
+// mesmos HttpClient e limites do multi handle. No máximo
+// HTTP_MAX_CONNECTIONS requisições rodam juntas: o ciclo leva
+// ceil(fontes / HTTP_MAX_CONNECTIONS) vezes a latência.
+int benchmarkMultiPoll(const std::string& apiUrl, int count) {
+    CURLM* multi = curl_multi_init();
+    curl_multi_setopt(multi, CURLMOPT_MAX_TOTAL_CONNECTIONS, (long)HTTP_MAX_CONNECTIONS);
+    curl_multi_setopt(multi, CURLMOPT_MAXCONNECTS, (long)HTTP_MAX_CONNECTIONS);
+    std::vector<std::unique_ptr<HttpClient>> clients;
+    for (int i = 0; i < count; i++) {
+        char spec[64];
+        std::snprintf(spec, sizeof(spec), "bench_%03d=City %d,BR", i, i);
+        WeatherSource source;
+        parseWeatherSource(spec, apiUrl, source);
+        clients.emplace_back(new HttpClient());
+        clients[i]->prepare(source.url);
+        curl_easy_setopt(clients[i]->handle(), CURLOPT_PRIVATE, (void*)(size_t)i);
+    }
+
+    int succeeded = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (const std::unique_ptr<HttpClient>& client : clients) {
+        curl_multi_add_handle(multi, client->handle());
+    }
+    int running = count;
+    while (running > 0) {
+        curl_multi_perform(multi, &running);
+        int queued = 0;
+        while (CURLMsg* msg = curl_multi_info_read(multi, &queued)) {
+            if (msg->msg != CURLMSG_DONE) {
+                continue;
+            }
+            void* privateData = nullptr;
+            curl_easy_getinfo(msg->easy_handle, CURLINFO_PRIVATE, &privateData);
+            curl_multi_remove_handle(multi, msg->easy_handle);
+            if (clients[(size_t)privateData]->finish(msg->data.result)) {
+                succeeded++;
+            }
+        }
+        if (running > 0) {
+            curl_multi_poll(multi, nullptr, 0, 1000, nullptr);
+        }
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    curl_multi_cleanup(multi);
+
+    std::cout << "multipoll: " << succeeded << " of " << count << " sources responded in "
+              << seconds << " s" << std::endl;
+    return succeeded == count ? 0 : 1;
+}
+
+int main(int argc, char* argv[]) {
+    const std::string name = argc > 1 ? argv[1] : "";
+    if (name == "--bench-encode") {
+        return benchmarkEncode(argc > 2 ? std::atoi(argv[2]) : 1000000);
+    }
+    if (name == "--bench-parse") {
+        return benchmarkWeatherParse(argc > 2 ? std::atoi(argv[2]) : 200000);
+    }
+    if ((name == "--bench-keepalive" || name == "--bench-multipoll") && argc > 2) {
+        curl_global_init(CURL_GLOBAL_DEFAULT);
+        int rc = name == "--bench-keepalive"
+            ? benchmarkKeepAlive(argv[2], argc > 3 ? std::atoi(argv[3]) : 500)
+            : benchmarkMultiPoll(argv[2], argc > 3 ? std::atoi(argv[3]) : 200);
+        curl_global_cleanup();
+        return rc;
+    }
+    std::cerr << "Usage: " << argv[0] << " --bench-encode [n] | --bench-parse [n]"
+              << " | --bench-keepalive <api-url> [polls] | --bench-multipoll <api-url> [sources]" << std::endl;
+    return -1;
+}
@@ -0,0 +1,678 @@
+// Benchmarks do data_processor. Ficam fora do binário de produção: este
+// arquivo compila o processador inteiro sem o main dele e acrescenta os
+// benchmarks. Compilar a partir de TPF/:
+//   g++ -std=c++17 -O2 bench/processor_bench.cpp -o processor_bench -lpaho-mqttpp3 -lpaho-mqtt3as -lsqlite3 -lpthread
+// Uso: ./processor_bench --bench-<nome> [quantidade]
+#define DATA_PROCESSOR_NO_MAIN
+#include "../data_processor.cpp"
+
+// Benchmark do custo por insert: prepare/finalize a cada linha (caminho
+// antigo) contra o statement em cache. Roda em um banco em memória para
+// medir só o custo de CPU, sem fsync.
+int benchmarkInserts(int rows) {
+    if (sqlite3_open(":memory:", &db) != SQLITE_OK || createTables() != 0) {
+        std::cerr << "Error opening benchmark database" << std::endl;
+        return -1;
+    }
+    const std::string machineId = MACHINE_ID;
+    const std::string sensorId = "sensor_temperature";
+    const Timestamp timestamp = currentTimestamp();
+
+    execSQL("BEGIN;");
+    const sqlite3_int64 sensor = dimensionIds.sensor(machineId, sensorId);
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < rows; i++) {
+        sqlite3_stmt* stmt;
+        sqlite3_prepare_v2(db, INSERT_READING_SQL.c_str(), -1, &stmt, 0);
+        sqlite3_bind_int64(stmt, 1, sensor);
+        sqlite3_bind_int64(stmt, 2, timestamp + i);
+        sqlite3_bind_double(stmt, 3, 20.0 + i % 10);
+        sqlite3_step(stmt);
+        sqlite3_finalize(stmt);
+    }
+    auto middle = std::chrono::steady_clock::now();
+    for (int i = 0; i < rows; i++) {
+        insertSensorData(machineId, sensorId, 20.0f + i % 10, timestamp + rows + i);
+    }
+    auto end = std::chrono::steady_clock::now();
+    execSQL("COMMIT;");
+
+    double uncachedNs = std::chrono::duration<double, std::nano>(middle - start).count() / rows;
+    double cachedNs = std::chrono::duration<double, std::nano>(end - middle).count() / rows;
+    std::cout << "insert (prepare por linha): " << uncachedNs << " ns/insert" << std::endl;
+    std::cout << "insert (statement em cache): " << cachedNs << " ns/insert" << std::endl;
+
+    statementCache.clear();
+    dimensionIds.clear();
+    sqlite3_close(db);
+    return 0;
+}
+
+// Mede vazão de insert (pelo BatchWriter) e latência de um leitor
+// concorrente que consulta as últimas leituras, para um perfil de storage
+void benchmarkStorageProfile(StorageProfile profile, const std::string& name, int rows) {
+    const std::string path = "bench_" + name + ".db";
+    const std::string files[] = {path, path + "-wal", path + "-shm", path + "-journal"};
+    for (const std::string& file : files) {
+        std::remove(file.c_str());
+    }
+    if (sqlite3_open(path.c_str(), &db) != SQLITE_OK || configureStorage(profile) != 0 || createTables() != 0) {
+        std::cerr << "Error opening benchmark database " << path << std::endl;
+        return;
+    }
+    CheckpointScheduler checkpointer(path, std::chrono::milliseconds(CHECKPOINT_INTERVAL_MS));
+    if (profile == StorageProfile::TUNED) {
+        checkpointer.start();
+    }
+
+    std::atomic<bool> writing(true);
+    std::vector<double> latencies;
+    std::thread reader([&] {
+        sqlite3* readerDb;
+        sqlite3_open(path.c_str(), &readerDb);
+        sqlite3_busy_timeout(readerDb, 10000);
+        sqlite3_stmt* stmt;
+        sqlite3_prepare_v2(readerDb, "SELECT COUNT(*), AVG(value) FROM (SELECT value FROM readings ORDER BY sensor DESC, timestamp_ns DESC LIMIT 100);", -1, &stmt, 0);
+        while (writing) {
+            auto start = std::chrono::steady_clock::now();
+            while (sqlite3_step(stmt) == SQLITE_ROW) {
+            }
+            sqlite3_reset(stmt);
+            latencies.push_back(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        sqlite3_finalize(stmt);
+        sqlite3_close(readerDb);
+    });
+
+    const std::string sensorId = "sensor_temperature";
+    const Timestamp timestamp = currentTimestamp();
+    auto start = std::chrono::steady_clock::now();
+    {
+        BatchWriter writer(BATCH_SIZE, std::chrono::milliseconds(BATCH_MAX_LATENCY_MS),
+                           BackpressurePolicy::BLOCK, STORAGE_QUEUE_CAPACITY, path + ".spill");
+        for (int i = 0; i < rows; i++) {
+            writer.addSensorData(MACHINE_ID, sensorId, 20.0f + i % 10, timestamp + i);
+        }
+        writer.stop();
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    writing = false;
+    reader.join();
+
+    checkpointer.stop();
+    statementCache.clear();
+    dimensionIds.clear();
+    sqlite3_close(db);
+    for (const std::string& file : files) {
+        std::remove(file.c_str());
+    }
+
+    std::sort(latencies.begin(), latencies.end());
+    auto percentile = [&](double p) {
+        return latencies.empty() ? 0.0 : latencies[(size_t)(p * (latencies.size() - 1))];
+    };
+    std::cout << name << ": " << (size_t)(rows / seconds) << " inserts/s, "
+              << latencies.size() << " leituras, p50=" << percentile(0.5) << " ms"
+              << " p99=" << percentile(0.99) << " ms max=" << percentile(1.0) << " ms" << std::endl;
+}
+
+int benchmarkStorage(int rows) {
+    benchmarkStorageProfile(StorageProfile::DEFAULT, "default", rows);
+    benchmarkStorageProfile(StorageProfile::TUNED, "tuned", rows);
+    return 0;
+}
+
+// Vazão do parse de payloads de sensor: leitor direto, SAX do json.hpp
+// (o fallback), a árvore completa (json::parse) e o CBOR
+int benchmarkParse(int messages) {
+    json sample;
+    sample["timestamp"] = "2025-01-31T00:02:50Z";
+    sample["value"] = 20.79f;
+    const std::string payload = sample.dump(1, '\t');
+
+    // A mesma leitura em CBOR: {0: timestamp em ns, 1: float32}
+    Timestamp sampleTimestamp = 0;
+    parseTimestamp("2025-01-31T00:02:50Z", sampleTimestamp);
+    float sampleValue = 20.79f;
+    uint32_t valueBits;
+    std::memcpy(&valueBits, &sampleValue, sizeof(valueBits));
+    std::string cborPayload = {(char)0xa2, CBOR_READING_KEY_TIMESTAMP, (char)0x1b};
+    for (int shift = 56; shift >= 0; shift -= 8) {
+        cborPayload += (char)(sampleTimestamp >> shift);
+    }
+    cborPayload += {CBOR_READING_KEY_VALUE, (char)0xfa};
+    for (int shift = 24; shift >= 0; shift -= 8) {
+        cborPayload += (char)(valueBits >> shift);
+    }
+
+    double checksum = 0.0;
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < messages; i++) {
+        float value;
+        Timestamp timestamp;
+        if (parseSensorPayload(payload, value, timestamp)) {
+            checksum += value + timestamp % 7;
+        }
+    }
+    auto middle = std::chrono::steady_clock::now();
+    for (int i = 0; i < messages; i++) {
+        float value;
+        Timestamp timestamp;
+        if (parseSensorPayloadSAX(payload, value, timestamp)) {
+            checksum += value + timestamp % 7;
+        }
+    }
+    auto saxEnd = std::chrono::steady_clock::now();
+    for (int i = 0; i < messages; i++) {
+        json root = json::parse(payload, nullptr, false);
+        if (!root.is_discarded()) {
+            checksum += root["value"].get<float>() + root["timestamp"].get_ref<const std::string&>().size();
+        }
+    }
+    auto end = std::chrono::steady_clock::now();
+    for (int i = 0; i < messages; i++) {
+        float value;
+        Timestamp timestamp;
+        if (parseSensorPayloadCBOR(cborPayload, value, timestamp)) {
+            checksum += value + timestamp % 7;
+        }
+    }
+    auto cborEnd = std::chrono::steady_clock::now();
+
+    double fastSeconds = std::chrono::duration<double>(middle - start).count();
+    double saxSeconds = std::chrono::duration<double>(saxEnd - middle).count();
+    double domSeconds = std::chrono::duration<double>(end - saxEnd).count();
+    double cborSeconds = std::chrono::duration<double>(cborEnd - end).count();
+    std::cout << "parse direto: " << (size_t)(messages / fastSeconds) << " msgs/s (" << payload.size() << " bytes)" << std::endl;
+    std::cout << "parse sax: " << (size_t)(messages / saxSeconds) << " msgs/s (" << payload.size() << " bytes)" << std::endl;
+    std::cout << "parse dom: " << (size_t)(messages / domSeconds) << " msgs/s (" << payload.size() << " bytes)" << std::endl;
+    std::cout << "parse cbor: " << (size_t)(messages / cborSeconds) << " msgs/s (" << cborPayload.size() << " bytes)" << std::endl;
+    std::cout << "(checksum " << checksum << ")" << std::endl;
+    return 0;
+}
+
+// Compara o armazenamento colunar com a tabela readings: bytes por
+// leitura e tempo de uma consulta por faixa de tempo de um sensor. As
+// leituras são sintéticas: 10 máquinas x 2 sensores a cada DATA_INTERVAL,
+// com valores de duas casas decimais em passeio aleatório.
+int benchmarkColumns(int rows) {
+    const std::string path = "bench_columns.db";
+    const std::string directory = "bench_columns";
+    const std::string files[] = {path, path + "-wal", path + "-shm", path + "-journal"};
+    auto cleanup = [&] {
+        for (const std::string& file : files) {
+            std::remove(file.c_str());
+        }
+        std::error_code error;
+        std::filesystem::remove_all(directory, error);
+    };
+    cleanup();
+    if (sqlite3_open(path.c_str(), &db) != SQLITE_OK || configureStorage(StorageProfile::TUNED) != 0 ||
+        createTables() != 0) {
+        std::cerr << "Error opening benchmark database " << path << std::endl;
+        return -1;
+    }
+
+    const int machines = 10;
+    const std::string sensors[] = {SENSOR_ID_TEMPERATURE, SENSOR_ID_HUMIDITY};
+    const int seriesCount = machines * 2;
+    std::vector<std::string> machineIds;
+    for (int m = 0; m < machines; m++) {
+        char name[16];
+        std::snprintf(name, sizeof(name), "machine_%02d", m);
+        machineIds.push_back(name);
+    }
+    std::vector<int> cents(seriesCount, 2000);
+    std::mt19937 random(42);
+    std::uniform_int_distribution<int> step(-5, 5);
+    const Timestamp start = currentTimestamp() / NANOS_PER_SECOND * NANOS_PER_SECOND;
+    const Timestamp period = DATA_INTERVAL * NANOS_PER_SECOND;
+    const int periods = (rows + seriesCount - 1) / seriesCount;
+
+    {
+        ColumnStore columns(directory);
+        if (columns.open() != 0) {
+            return -1;
+        }
+        execSQL("BEGIN;");
+        for (int i = 0; i < rows; i++) {
+            int series = i % seriesCount;
+            cents[series] += step(random);
+            float value = cents[series] / 100.0f;
+            Timestamp timestamp = start + (Timestamp)(i / seriesCount) * period;
+            const std::string& machineId = machineIds[series / 2];
+            const std::string& sensorId = sensors[series % 2];
+            insertSensorData(machineId, sensorId, value, timestamp);
+            columns.append(machineId, sensorId, timestamp, value);
+            if ((i + 1) % BATCH_SIZE == 0) {
+                execSQL("COMMIT;");
+                execSQL("BEGIN;");
+                columns.sync();
+            }
+        }
+        execSQL("COMMIT;");
+        execSQL("PRAGMA wal_checkpoint(TRUNCATE);");
+    }
+    std::error_code error;
+    uint64_t sqliteBytes = std::filesystem::file_size(path, error);
+    uint64_t columnBytes = ColumnStore(directory, false).diskBytes();
+    std::cout << "sqlite: " << (double)sqliteBytes / rows << " bytes/leitura" << std::endl;
+    std::cout << "columnar: " << (double)columnBytes / rows << " bytes/leitura ("
+              << (double)sqliteBytes / columnBytes << "x menor)" << std::endl;
+
+    // 10% do período de um sensor, no meio da série
+    const Timestamp from = start + (Timestamp)(periods * 45 / 100) * period;
+    const Timestamp to = start + (Timestamp)(periods * 55 / 100) * period;
+    const int repetitions = 5;
+    auto best = [&](const std::function<size_t()>& query, size_t& found) {
+        double fastest = 0;
+        for (int r = 0; r < repetitions; r++) {
+            auto begin = std::chrono::steady_clock::now();
+            found = query();
+            double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - begin).count();
+            fastest = r == 0 ? ms : std::min(fastest, ms);
+        }
+        return fastest;
+    };
+
+    sqlite3_stmt* stmt;
+    sqlite3_prepare_v2(db, "SELECT timestamp_ns, value FROM readings"
+                           " WHERE sensor = ? AND timestamp_ns BETWEEN ? AND ?;", -1, &stmt, 0);
+    const sqlite3_int64 sensor = dimensionIds.sensor(machineIds[0], SENSOR_ID_TEMPERATURE);
+    size_t sqliteRows = 0;
+    double sqliteMs = best([&] {
+        size_t found = 0;
+        sqlite3_bind_int64(stmt, 1, sensor);
+        sqlite3_bind_int64(stmt, 2, from);
+        sqlite3_bind_int64(stmt, 3, to);
+        while (sqlite3_step(stmt) == SQLITE_ROW) {
+            found++;
+        }
+        sqlite3_reset(stmt);
+        return found;
+    }, sqliteRows);
+    sqlite3_finalize(stmt);
+
+    size_t columnRows = 0;
+    double columnMs = best([&] {
+        size_t found = 0;
+        ColumnStore reader(directory, false);
+        reader.scan(machineIds[0], SENSOR_ID_TEMPERATURE, from, to, [&](Timestamp, float) {
+            found++;
+        });
+        return found;
+    }, columnRows);
+
+    std::cout << "faixa de tempo (sqlite): " << sqliteMs << " ms, " << sqliteRows << " linhas" << std::endl;
+    std::cout << "faixa de tempo (columnar): " << columnMs << " ms, " << columnRows << " linhas" << std::endl;
+
+    statementCache.clear();
+    dimensionIds.clear();
+    sqlite3_close(db);
+    cleanup();
+    return 0;
+}
+
+// Latência das consultas do --query sobre uma tabela sintética: 10 máquinas
+// x 10 sensores a cada DATA_INTERVAL. O banco (bench_query.db) é mantido e
+// reaproveitado quando já tem o número de linhas pedido, porque gerar
+// dezenas de milhões de linhas leva minutos.
+int benchmarkQueries(int64_t rows) {
+    const std::string path = "bench_query.db";
+    if (sqlite3_open(path.c_str(), &db) != SQLITE_OK || configureStorage(StorageProfile::TUNED) != 0 ||
+        createTables() != 0) {
+        std::cerr << "Error opening benchmark database " << path << std::endl;
+        return -1;
+    }
+
+    const int machines = 10;
+    const int sensorsPerMachine = 10;
+    const int sensorCount = machines * sensorsPerMachine;
+    std::vector<std::string> machineIds;
+    std::vector<std::string> sensorIds;
+    for (int i = 0; i < machines; i++) {
+        machineIds.push_back("machine_" + std::to_string(i));
+    }
+    for (int i = 0; i < sensorsPerMachine; i++) {
+        sensorIds.push_back("sensor_" + std::to_string(i));
+    }
+    Timestamp start = 0;
+    parseTimestamp("2025-01-01T00:00:00Z", start);
+    const Timestamp period = DATA_INTERVAL * NANOS_PER_SECOND;
+    const int64_t periods = rows / sensorCount;
+    const Timestamp end = start + (periods - 1) * period;
+
+    if (countRows("readings") != periods * sensorCount) {
+        std::cout << "Generating " << periods * sensorCount << " readings in " << path << "..." << std::endl;
+        execSQL("DELETE FROM readings;");
+        for (const RollupLevel& level : ROLLUP_LEVELS) {
+            execSQL((std::string("DELETE FROM ") + level.table + ";").c_str());
+        }
+        std::mt19937 random(42);
+        std::uniform_int_distribution<int> step(-5, 5);
+        std::vector<int> cents(sensorCount, 2000);
+        RollupAccumulator rollups;
+        auto begin = std::chrono::steady_clock::now();
+        execSQL("BEGIN;");
+        for (int64_t p = 0; p < periods; p++) {
+            for (int s = 0; s < sensorCount; s++) {
+                cents[s] += step(random);
+                const std::string& machineId = machineIds[s / sensorsPerMachine];
+                const std::string& sensorId = sensorIds[s % sensorsPerMachine];
+                insertSensorData(machineId, sensorId, cents[s] / 100.0f, start + p * period);
+                rollups.add(machineId, sensorId, start + p * period, cents[s] / 100.0f);
+            }
+            if ((p + 1) % 1000 == 0) {
+                rollups.flush();
+                execSQL("COMMIT;");
+                execSQL("BEGIN;");
+            }
+        }
+        rollups.flush();
+        execSQL("COMMIT;");
+        execSQL("PRAGMA wal_checkpoint(TRUNCATE);");
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+        std::cout << "  " << (int64_t)(periods * sensorCount / seconds) << " inserts/s" << std::endl;
+    }
+    std::error_code error;
+    std::cout << periods * sensorCount << " leituras, " << std::filesystem::file_size(path, error) / (1024 * 1024)
+              << " MiB" << std::endl;
+
+    const std::string* plans[] = {&SELECT_RANGE_SQL, &SELECT_LATEST_SQL, &SELECT_ALARMS_SQL};
+    for (const std::string* sql : plans) {
+        sqlite3_stmt* stmt;
+        std::string explain = "EXPLAIN QUERY PLAN " + *sql;
+        if (sqlite3_prepare_v2(db, explain.c_str(), -1, &stmt, 0) == SQLITE_OK) {
+            std::cout << "plano: " << sql->substr(0, 60) << "..." << std::endl;
+            while (sqlite3_step(stmt) == SQLITE_ROW) {
+                std::cout << "    " << (const char*)sqlite3_column_text(stmt, 3) << std::endl;
+            }
+        }
+        sqlite3_finalize(stmt);
+    }
+
+    std::mt19937 random(7);
+    const int repetitions = 200;
+    auto measure = [&](const std::string& name, Timestamp window, const std::function<int64_t(int, Timestamp)>& query) {
+        std::uniform_int_distribution<int> pickSensor(0, sensorCount - 1);
+        std::uniform_int_distribution<int64_t> pickEnd(std::min(start + window, end), end);
+        std::vector<double> latencies;
+        int64_t found = 0;
+        for (int r = 0; r < repetitions; r++) {
+            int sensor = pickSensor(random);
+            Timestamp to = pickEnd(random);
+            auto begin = std::chrono::steady_clock::now();
+            found += query(sensor, to);
+            latencies.push_back(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - begin).count());
+        }
+        std::sort(latencies.begin(), latencies.end());
+        std::cout << name << ": p50=" << latencies[latencies.size() / 2] << " ms p99="
+                  << latencies[latencies.size() * 99 / 100] << " ms, " << found / repetitions << " linhas/consulta" << std::endl;
+    };
+    auto sensorRow = [&](int sensor) {
+        return dimensionIds.sensor(machineIds[sensor / sensorsPerMachine], sensorIds[sensor % sensorsPerMachine]);
+    };
+    const Timestamp hour = 3600 * NANOS_PER_SECOND;
+    const Timestamp day = 24 * hour;
+
+    measure("latest (1 sensor)", 0, [&](int sensor, Timestamp) {
+        int64_t found = 0;
+        queryLatest(machineIds[sensor / sensorsPerMachine], sensorIds[sensor % sensorsPerMachine],
+                    [&](std::string_view, Timestamp, double) { found++; });
+        return found;
+    });
+    measure("latest (máquina)", 0, [&](int sensor, Timestamp) {
+        int64_t found = 0;
+        queryLatest(machineIds[sensor / sensorsPerMachine], "", [&](std::string_view, Timestamp, double) { found++; });
+        return found;
+    });
+    for (Timestamp window : {hour, day}) {
+        measure(window == hour ? "range 1h" : "range 1d", window, [&](int sensor, Timestamp to) {
+            int64_t found = 0;
+            queryRange(sensorRow(sensor), to - window, to, [&](Timestamp, double) { found++; });
+            return found;
+        });
+    }
+    // As agregações rodam sobre as leituras brutas e sobre os rollups
+    for (bool useRollups : {false, true}) {
+        const std::string source = useRollups ? " (rollups)" : " (bruto)";
+        measure("aggregate 1d por hora" + source, day, [&](int sensor, Timestamp to) {
+            int64_t found = 0;
+            queryAggregate(sensorRow(sensor), to - day, to, hour, [&](const ReadingAggregate&) { found++; },
+                           useRollups);
+            return found;
+        });
+        measure("aggregate 30d" + source, 30 * day, [&](int sensor, Timestamp to) {
+            ReadingAggregate total;
+            aggregateSpan(sensorRow(sensor), to - 30 * day, to, useRollups ? ROLLUP_LEVEL_COUNT - 1 : -1, total);
+            return total.count;
+        });
+    }
+
+    statementCache.clear();
+    dimensionIds.clear();
+    sqlite3_close(db);
+    return 0;
+}
+
+// Latência de commit de lotes de 1000 leituras enquanto a retenção apaga
+// metade do banco: em blocos de RETENTION_CHUNK_ROWS contra um único DELETE
+// por sensor. Cada rodada recria o banco com leituras que vão de 60 dias
+// atrás até agora, com retenção de 30 dias.
+void benchmarkRetentionChunks(const std::string& name, int rows, int chunkRows) {
+    const std::string path = "bench_retention.db";
+    const std::string files[] = {path, path + "-wal", path + "-shm", path + "-journal"};
+    for (const std::string& file : files) {
+        std::remove(file.c_str());
+    }
+    if (sqlite3_open(path.c_str(), &db) != SQLITE_OK || configureStorage(StorageProfile::TUNED) != 0 ||
+        createTables() != 0) {
+        std::cerr << "Error opening benchmark database " << path << std::endl;
+        return;
+    }
+
+    const int sensorCount = 10;
+    const Timestamp day = 24 * 3600 * NANOS_PER_SECOND;
+    const Timestamp now = currentTimestamp();
+    const Timestamp period = 60 * day / (rows / sensorCount);
+    execSQL("BEGIN;");
+    for (int i = 0; i < rows; i++) {
+        insertSensorData(MACHINE_ID, "sensor_" + std::to_string(i % sensorCount), 20.0f + i % 10,
+                         now - 60 * day + (i / sensorCount) * period);
+    }
+    execSQL("COMMIT;");
+    execSQL("PRAGMA wal_checkpoint(TRUNCATE);");
+
+    RetentionPolicy policy;
+    policy.readingsNs = 30 * day;
+    RetentionCompactor compactor(path, policy, std::chrono::hours(1), chunkRows);
+    std::vector<double> latencies;
+    auto begin = std::chrono::steady_clock::now();
+    compactor.start();
+    for (int batch = 0; compactor.passes() == 0 || batch < 100; batch++) {
+        auto start = std::chrono::steady_clock::now();
+        execSQL("BEGIN IMMEDIATE;");
+        for (int i = 0; i < 1000; i++) {
+            insertSensorData(MACHINE_ID, "sensor_" + std::to_string(i % sensorCount), 20.0f, now + batch * 1000 + i);
+        }
+        execSQL("COMMIT;");
+        latencies.push_back(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+    compactor.stop();
+
+    statementCache.clear();
+    dimensionIds.clear();
+    sqlite3_close(db);
+    for (const std::string& file : files) {
+        std::remove(file.c_str());
+    }
+
+    std::sort(latencies.begin(), latencies.end());
+    auto percentile = [&](double p) { return latencies[(size_t)(p * (latencies.size() - 1))]; };
+    std::cout << name << ": " << compactor.deleted() << " linhas apagadas em " << seconds << " s, "
+              << latencies.size() << " lotes, commit p50=" << percentile(0.5) << " ms p99=" << percentile(0.99)
+              << " ms max=" << percentile(1.0) << " ms" << std::endl;
+}
+
+int benchmarkRetention(int rows) {
+    benchmarkRetentionChunks("em blocos", rows, RETENTION_CHUNK_ROWS);
+    benchmarkRetentionChunks("DELETE único", rows, std::numeric_limits<int>::max());
+    return 0;
+}
+
+// 30 dias simulados de leituras (100 sensores) gravados pelo BatchWriter em
+// um arquivo só e em partições diárias: vazão de insert de cada dia e
+// tamanho do arquivo que recebe os inserts. O dia só termina depois de um
+// checkpoint TRUNCATE, para que a vazão inclua a escrita das páginas no
+// arquivo (onde a B-tree maior pesa) e não dependa de quando o WAL foi
+// esvaziado. Depois, consultas de período sobre o banco particionado
+// contando quantas partições cada uma anexou.
+void benchmarkPartitionLayout(const std::string& name, int64_t rowsPerDay, bool partitioned) {
+    const std::string path = "bench_partition.db";
+    const std::string stem = std::filesystem::path(path).stem().string();
+    auto removeFiles = [&] {
+        for (const auto& entry : std::filesystem::directory_iterator(".")) {
+            std::string file = entry.path().filename().string();
+            if (file.rfind(stem, 0) == 0) {
+                std::remove(file.c_str());
+            }
+        }
+    };
+    removeFiles();
+    const Timestamp day = 24 * 3600 * NANOS_PER_SECOND;
+    if (sqlite3_open(path.c_str(), &db) != SQLITE_OK || configureStorage(StorageProfile::TUNED) != 0 ||
+        createTables() != 0 || partitions.open(path, partitioned ? day : 0) != 0) {
+        std::cerr << "Error opening benchmark database " << path << std::endl;
+        return;
+    }
+
+    const int machines = 10;
+    const int sensorsPerMachine = 10;
+    const int sensorCount = machines * sensorsPerMachine;
+    Timestamp start = 0;
+    parseTimestamp("2025-01-01T00:00:00Z", start);
+    const int64_t periodsPerDay = rowsPerDay / sensorCount;
+    const Timestamp period = day / periodsPerDay;
+    const int days = 30;
+
+    std::cout << name << ":" << std::endl;
+    std::vector<double> rates;
+    {
+        BatchWriter writer(BATCH_SIZE, std::chrono::milliseconds(BATCH_MAX_LATENCY_MS),
+                           BackpressurePolicy::BLOCK, STORAGE_QUEUE_CAPACITY, path + ".spill");
+        std::vector<std::string> machineIds;
+        std::vector<std::string> sensorIds;
+        for (int i = 0; i < machines; i++) {
+            machineIds.push_back("machine_" + std::to_string(i));
+        }
+        for (int i = 0; i < sensorsPerMachine; i++) {
+            sensorIds.push_back("sensor_" + std::to_string(i));
+        }
+        uint64_t total = 0;
+        for (int d = 0; d < days; d++) {
+            auto begin = std::chrono::steady_clock::now();
+            for (int64_t p = 0; p < periodsPerDay; p++) {
+                const Timestamp timestamp = start + d * day + p * period;
+                for (int s = 0; s < sensorCount; s++) {
+                    writer.addSensorData(machineIds[s / sensorsPerMachine], sensorIds[s % sensorsPerMachine],
+                                         20.0f + (p + s) % 100 / 10.0f, timestamp);
+                }
+            }
+            total += periodsPerDay * sensorCount;
+            while (writer.stats().committed < total) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            }
+            // Sem schema, o checkpoint cobre o banco principal e as partições anexadas
+            execSQL("PRAGMA wal_checkpoint(TRUNCATE);");
+            double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+            rates.push_back(periodsPerDay * sensorCount / seconds);
+
+            // Com partições, o arquivo quente é o da janela mais nova
+            std::error_code error;
+            uintmax_t hotBytes = std::filesystem::file_size(partitioned ? partitions.newestPath() : path, error);
+            if (d == 0 || (d + 1) % 5 == 0) {
+                std::cout << "  dia " << std::setw(2) << d + 1 << ": " << (int64_t)rates.back() << " inserts/s, arquivo quente "
+                          << hotBytes / (1024 * 1024) << " MiB" << std::endl;
+            }
+        }
+        writer.stop();
+    }
+    double firstWeek = 0;
+    double lastWeek = 0;
+    for (int d = 0; d < 7; d++) {
+        firstWeek += rates[d] / 7;
+        lastWeek += rates[days - 7 + d] / 7;
+    }
+    std::cout << "  última semana / primeira semana: " << std::setprecision(3) << lastWeek / firstWeek << std::endl;
+
+    statementCache.clear();
+    dimensionIds.clear();
+    partitions.clear();
+    sqlite3_close(db);
+
+    // Consultas em uma conexão nova, como o --query: nenhuma partição anexada
+    if (partitioned && sqlite3_open_v2(path.c_str(), &db, SQLITE_OPEN_READONLY, nullptr) == SQLITE_OK &&
+        partitions.open(path, 0) == 0) {
+        std::mt19937 random(7);
+        std::uniform_int_distribution<int64_t> pickEnd(start + 3 * day, start + days * day - 1);
+        std::uniform_int_distribution<int> pickSensor(1, sensorCount);
+        const Timestamp hour = 3600 * NANOS_PER_SECOND;
+        for (Timestamp window : {hour, day, 3 * day}) {
+            const int repetitions = 100;
+            uint64_t attaches = partitions.attachCount();
+            int64_t found = 0;
+            std::vector<double> latencies;
+            for (int r = 0; r < repetitions; r++) {
+                Timestamp to = pickEnd(random);
+                auto begin = std::chrono::steady_clock::now();
+                queryRange(pickSensor(random), to - window, to, [&](Timestamp, double) { found++; });
+                latencies.push_back(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - begin).count());
+            }
+            std::sort(latencies.begin(), latencies.end());
+            std::cout << "  range " << window / hour << "h: p50=" << latencies[repetitions / 2] << " ms, "
+                      << (double)(partitions.attachCount() - attaches) / repetitions << " de " << partitions.size()
+                      << " partições anexadas/consulta, " << found / repetitions << " linhas/consulta" << std::endl;
+        }
+        statementCache.clear();
+        partitions.clear();
+        sqlite3_close(db);
+    }
+    removeFiles();
+}
+
+int benchmarkPartitions(int64_t rowsPerDay) {
+    benchmarkPartitionLayout("arquivo único", rowsPerDay, false);
+    benchmarkPartitionLayout("partições diárias", rowsPerDay, true);
+    return 0;
+}
+
+int main(int argc, char* argv[]) {
+    const std::string name = argc > 1 ? argv[1] : "";
+    if (name == "--bench-insert") {
+        return benchmarkInserts(argc > 2 ? std::atoi(argv[2]) : 200000);
+    }
+    if (name == "--bench-storage") {
+        return benchmarkStorage(argc > 2 ? std::atoi(argv[2]) : 500000);
+    }
+    if (name == "--bench-parse") {
+        return benchmarkParse(argc > 2 ? std::atoi(argv[2]) : 2000000);
+    }
+    if (name == "--bench-columns") {
+        return benchmarkColumns(argc > 2 ? std::atoi(argv[2]) : 2000000);
+    }
+    if (name == "--bench-query") {
+        return benchmarkQueries(argc > 2 ? std::atoll(argv[2]) : 10000000);
+    }
+    if (name == "--bench-retention") {
+        return benchmarkRetention(argc > 2 ? std::atoi(argv[2]) : 2000000);
+    }
+    if (name == "--bench-partitions") {
+        return benchmarkPartitions(argc > 2 ? std::atoll(argv[2]) : 500000);
+    }
+    std::cerr << "Usage: " << argv[0] << " --bench-insert | --bench-storage | --bench-parse | --bench-columns |"
+              << " --bench-query | --bench-retention | --bench-partitions [n]" << std::endl;
+    return -1;
+}
@@ -0,0 +1,121 @@
+// Teste do AsyncPublisher contra um mosquitto de verdade, que o próprio
+// teste inicia (precisa do binário mosquitto no PATH) e encerra no fim.
+// Compilar com o AddressSanitizer e rodar a partir de TPF/:
+//   g++ -std=c++17 -O1 -g -fsanitize=address bench/publisher_test.cpp -o publisher_test -lpaho-mqttpp3 -lpaho-mqtt3as -lcurl -lpthread
+//   ./publisher_test [porta]   (padrão 18830; sai com 1 se alguma etapa falhar)
+// A segunda etapa deixa confirmações chegarem depois de o publisher ser
+// destruído; se elas tocarem no objeto, o ASan acusa heap-use-after-free.
+#define DATA_COLLECTOR_NO_MAIN
+#include "../data_colletor.cpp"
+#include <signal.h>
+#include <sys/wait.h>
+
+const std::string TEST_TOPIC("/bench/publisher");
+
+// Conta as mensagens recebidas pelo assinante
+class CountingCallback : public mqtt::callback {
+public:
+    std::atomic<uint64_t> received{0};
+
+    void message_arrived(mqtt::const_message_ptr) override {
+        received++;
+    }
+};
+
+void connectPublisher(mqtt::async_client& client) {
+    mqtt::connect_options options;
+    options.set_max_inflight((int)PUBLISH_MAX_INFLIGHT);
+    client.connect(options)->wait();
+}
+
+// Todas as leituras publicadas chegam a um assinante e são contadas como
+// publicadas, sem retentativas nem descartes
+int testDelivery(const std::string& address, int messages) {
+    mqtt::async_client subscriber(address, "PublisherTestSubscriber");
+    CountingCallback counter;
+    subscriber.set_callback(counter);
+    subscriber.connect()->wait();
+    subscriber.subscribe(TEST_TOPIC, 1)->wait();
+
+    mqtt::async_client client(address, "PublisherTestClient");
+    connectPublisher(client);
+    AsyncPublisher::Stats stats;
+    {
+        AsyncPublisher publisher(client);
+        ReadingSerializer serializer;
+        const Timestamp timestamp = currentTimestamp();
+        for (int i = 0; i < messages; i++) {
+            publisher.publish(TEST_TOPIC, serializer.serialize(timestamp + i, 20.0f + (i & 7)));
+        }
+        publisher.stop();
+        stats = publisher.stats();
+    }
+    for (int i = 0; i < 50 && counter.received < (uint64_t)messages; i++) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    }
+    client.disconnect()->wait();
+    subscriber.disconnect()->wait();
+
+    std::cout << "delivery: published=" << stats.published << " retried=" << stats.retried
+              << " dropped=" << stats.dropped << " received=" << counter.received << " of " << messages << std::endl;
+    return stats.published == (uint64_t)messages && counter.received == (uint64_t)messages ? 0 : 1;
+}
+
+// Com o broker parado (SIGSTOP) as publicações grandes não saem do socket:
+// stop() desiste depois de PUBLISH_DRAIN_TIMEOUT_MS e o publisher é
+// destruído com publicações em andamento. Quando o broker volta (SIGCONT),
+// a paho entrega as confirmações atrasadas.
+int testLateCompletions(const std::string& address, pid_t broker) {
+    mqtt::async_client client(address, "PublisherTestLateClient");
+    connectPublisher(client);
+    const std::string payload(256 * 1024, 'x');
+    AsyncPublisher::Stats stats;
+    kill(broker, SIGSTOP);
+    {
+        AsyncPublisher publisher(client);
+        for (int i = 0; i < 200; i++) {
+            publisher.publish(TEST_TOPIC, payload);
+        }
+        publisher.stop();
+        stats = publisher.stats();
+    }
+    kill(broker, SIGCONT);
+    std::this_thread::sleep_for(std::chrono::seconds(3));
+    client.disconnect()->wait();
+
+    // Sem publicações abandonadas a etapa não testou nada
+    std::cout << "late completions: published=" << stats.published << " dropped=" << stats.dropped << std::endl;
+    return stats.dropped > 0 ? 0 : 1;
+}
+
+int main(int argc, char* argv[]) {
+    const std::string port = argc > 1 ? argv[1] : "18830";
+    const std::string address = "tcp://localhost:" + port;
+
+    pid_t broker = fork();
+    if (broker == 0) {
+        execlp("mosquitto", "mosquitto", "-p", port.c_str(), (char*)nullptr);
+        std::perror("mosquitto");
+        _exit(127);
+    }
+    if (broker < 0) {
+        std::perror("fork");
+        return 1;
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(500));
+
+    int rc = 1;
+    try {
+        rc = testDelivery(address, 10000);
+        rc |= testLateCompletions(address, broker);
+    } catch (const mqtt::exception& e) {
+        std::cerr << "MQTT error: " << e.what() << std::endl;
+        rc = 1;
+    }
+
+    kill(broker, SIGCONT);
+    kill(broker, SIGTERM);
+    waitpid(broker, nullptr, 0);
+    std::cout << (rc == 0 ? "OK" : "FAILED") << std::endl;
+    return rc;
+}
@@ -0,0 +1,75 @@
+#!/usr/bin/env python3
+# Servidor HTTP local que imita a API do OpenWeatherMap para os benchmarks
+# do coletor (bench/collector_bench.cpp). Responde qualquer GET com
+# {"main":{"temp":...,"humidity":...}} em HTTP/1.1 com keep-alive, uma
+# thread por conexão, e conta as conexões TCP aceitas.
+#   python3 bench/weather_stub.py [--port 8099] [--delay 0.5]
+# --delay atrasa cada resposta (latência da API). GET /stats devolve
+# {"connections": ..., "requests": ...} sem contar como requisição (a
+# conexão da própria consulta entra em connections); os totais também são
+# impressos ao encerrar (Ctrl+C).
+import argparse
+import json
+import threading
+import time
+from http.server import BaseHTTPRequestHandler, ThreadingHTTPServer
+
+lock = threading.Lock()
+counters = {"connections": 0, "requests": 0}
+
+
+class WeatherHandler(BaseHTTPRequestHandler):
+    protocol_version = "HTTP/1.1"
+    # Cabeçalho e corpo saem em escritas separadas; sem isso o Nagle segura
+    # o corpo até o ACK atrasado do cliente (~40 ms por requisição)
+    disable_nagle_algorithm = True
+    delay = 0.0
+
+    def setup(self):
+        super().setup()
+        with lock:
+            counters["connections"] += 1
+
+    def do_GET(self):
+        if self.path == "/stats":
+            with lock:
+                body = json.dumps(counters).encode()
+        else:
+            with lock:
+                counters["requests"] += 1
+            if self.delay > 0:
+                time.sleep(self.delay)
+            body = json.dumps({"main": {"temp": 24.5, "humidity": 61}}).encode()
+        self.send_response(200)
+        self.send_header("Content-Type", "application/json")
+        self.send_header("Content-Length", str(len(body)))
+        self.end_headers()
+        self.wfile.write(body)
+
+    def log_message(self, format, *args):
+        pass
+
+
+class WeatherServer(ThreadingHTTPServer):
+    daemon_threads = True
+    request_queue_size = 1024
+
+
+def main():
+    parser = argparse.ArgumentParser()
+    parser.add_argument("--port", type=int, default=8099)
+    parser.add_argument("--delay", type=float, default=0.0)
+    args = parser.parse_args()
+
+    WeatherHandler.delay = args.delay
+    server = WeatherServer(("127.0.0.1", args.port), WeatherHandler)
+    print("weather stub on http://127.0.0.1:%d (delay %.3f s)" % (args.port, args.delay), flush=True)
+    try:
+        server.serve_forever()
+    except KeyboardInterrupt:
+        pass
+    print("connections=%d requests=%d" % (counters["connections"], counters["requests"]), flush=True)
+
+
+if __name__ == "__main__":
+    main()
@@ -2,11 +2,29 @@
 #include <string>
 #include <mqtt/async_client.h>
 #include <curl/curl.h>
-#include <jsoncpp/json/json.h>
+#include "json.hpp"
 #include <chrono>
 #include <ctime>
 #include <thread>
 #include <iomanip>
+#include <cstdint>
+#include <vector>
+#include <memory>
+#include <fstream>
+#include <array>
+#include <queue>
+#include <atomic>
+#include <csignal>
+#include <algorithm>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <cstring>
+#include <string_view>
+#include <charconv>
+#include <cmath>
+#include <cstdlib>
 
 const std::string SERVER_ADDRESS("tcp://localhost:1883");
 const std::string CLIENT_ID("DataCollectorClient");
@@ -14,79 +32,787 @@ const std::string MACHINE_ID("machine_01");
 const std::string SENSOR_ID_TEMPERATURE("sensor_temperature");
 const std::string SENSOR_ID_HUMIDITY("sensor_humidity");
 const int DATA_INTERVAL = 10; // em segundos
+const std::string WEATHER_API_URL("http://api.openweathermap.org/data/2.5/weather");
+const std::string WEATHER_API_KEY("21309ecc4422778de48b2f48e31143cb");
+const int HTTP_DNS_CACHE_SECONDS = 300;
+const int HTTP_CONNECT_TIMEOUT_MS = 5000;
+const int HTTP_TIMEOUT_MS = 10000;
+const int HTTP_MAX_CONNECTIONS = 64; // conexões simultâneas no modo multi-fonte
+const int SCHEDULER_STATS_INTERVAL = 60; // em segundos, para o histograma de jitter
+const size_t PUBLISH_MAX_INFLIGHT = 256;    // publicações aguardando confirmação do broker
+const size_t PUBLISH_QUEUE_CAPACITY = 65536; // leituras aguardando a janela
+const int PUBLISH_MAX_RETRIES = 5;
+const int PUBLISH_RETRY_BACKOFF_MS = 100;   // dobra a cada tentativa
+const int PUBLISH_DRAIN_TIMEOUT_MS = 5000;  // espera máxima no encerramento
+const std::string SENSOR_BATCH_TOPIC("/sensor_batches"); // várias leituras por mensagem (--batch)
+const int SENSOR_BATCH_SCHEMA_VERSION = 1;
+const size_t MESSAGE_BATCH_MAX_READINGS = 500;
+const size_t MESSAGE_BATCH_MAX_BYTES = 64 * 1024;
+const int MESSAGE_BATCH_MAX_LATENCY_MS = 1000; // tempo máximo de uma leitura no lote
 
-// Função para obter o timestamp atual em formato ISO 8601
-std::string getCurrentTimestamp() {
-    auto now = std::chrono::system_clock::now();
-    auto now_time_t = std::chrono::system_clock::to_time_t(now);
-    std::ostringstream oss;
-    oss << std::put_time(std::gmtime(&now_time_t), "%Y-%m-%dT%H:%M:%SZ");
-    return oss.str();
+using json = nlohmann::json;
+
+// Sinaliza o encerramento do processo (SIGINT/SIGTERM)
+std::atomic<bool> keepRunning(true);
+
+// Timestamps circulam como nanossegundos desde a época (UTC); o texto
+// ISO 8601 só é gerado na hora de publicar
+using Timestamp = int64_t;
+
+const Timestamp NANOS_PER_SECOND = 1000000000;
+
+Timestamp currentTimestamp() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+// Escreve o timestamp em ISO 8601 ("YYYY-MM-DDTHH:MM:SSZ") em out (mínimo
+// de 21 bytes) e devolve o tamanho
+size_t formatTimestamp(Timestamp ts, char* out) {
+    time_t seconds = (time_t)(ts / NANOS_PER_SECOND - (ts % NANOS_PER_SECOND < 0 ? 1 : 0));
+    std::tm utc;
+    gmtime_r(&seconds, &utc);
+    return std::strftime(out, 21, "%Y-%m-%dT%H:%M:%SZ", &utc);
+}
+
+std::string formatTimestamp(Timestamp ts) {
+    char buffer[32];
+    return std::string(buffer, formatTimestamp(ts, buffer));
 }
 
-// Função para processar os dados da resposta HTTP e adicionar à string de origem
-size_t WriteCallback(void* contents, size_t size, size_t nmemb, void* bufferptr) {
-    ((std::string*)bufferptr)->append((char*)contents, size * nmemb);
+// Extrai main.temp e main.humidity de uma resposta da API enquanto o corpo
+// chega, pedaço a pedaço, direto do callback de escrita da libcurl. Só a
+// estrutura do JSON é acompanhada (aninhamento, strings, chaves): o corpo
+// não é guardado e nenhuma árvore é montada. Depois que o objeto "main" de
+// primeiro nível fecha com os dois campos, o resto é descartado sem olhar.
+class WeatherStreamParser {
+private:
+    enum class State {
+        VALUE,       // esperando um valor
+        KEY_OR_END,  // logo após '{': chave ou '}'
+        KEY,         // dentro de uma chave
+        COLON,       // depois da chave
+        STRING,      // dentro de uma string de valor
+        NUMBER,      // dentro de um número
+        LITERAL,     // true, false ou null
+        AFTER_VALUE, // ',' ou fechamento do container
+        DONE,
+        FAILED
+    };
+
+    static constexpr int MAX_DEPTH = 64;
+    static constexpr size_t MAX_TOKEN = 24; // chaves e números maiores não interessam
+
+    State state;
+    std::array<bool, MAX_DEPTH> isObject; // tipo de cada nível aberto
+    int depth;
+    bool afterComma; // depois de ',': o container não pode fechar ainda
+    bool escaped;
+    char token[MAX_TOKEN];
+    size_t tokenLength;
+    bool mainNext;  // a última chave de primeiro nível foi "main"
+    bool inMain;    // dentro do objeto "main" de primeiro nível
+    float* target;  // campo preenchido pelo próximo número
+    bool hasTemperature;
+    bool hasHumidity;
+
+    std::string_view tokenText() const {
+        return std::string_view(token, std::min(tokenLength, MAX_TOKEN));
+    }
+
+    void appendToken(char c) {
+        if (tokenLength < MAX_TOKEN) {
+            token[tokenLength] = c;
+        }
+        tokenLength++; // passa de MAX_TOKEN: o texto não casa com nada
+    }
+
+    void open(bool object) {
+        if (depth == MAX_DEPTH) {
+            state = State::FAILED;
+            return;
+        }
+        isObject[depth++] = object;
+        if (depth == 2) {
+            inMain = object && mainNext;
+        }
+        mainNext = false;
+        target = nullptr;
+        state = object ? State::KEY_OR_END : State::VALUE;
+    }
+
+    void close(bool object) {
+        if (depth == 0 || isObject[depth - 1] != object) {
+            state = State::FAILED;
+            return;
+        }
+        if (inMain && depth == 2) {
+            inMain = false;
+            if (complete()) {
+                state = State::DONE;
+                return;
+            }
+        }
+        depth--;
+        state = depth == 0 ? State::DONE : State::AFTER_VALUE;
+    }
+
+    void endKey() {
+        std::string_view key = tokenLength <= MAX_TOKEN ? tokenText() : std::string_view();
+        target = nullptr;
+        if (depth == 1) {
+            mainNext = key == "main";
+        } else if (inMain && depth == 2) {
+            if (key == "temp") {
+                target = &temperature;
+            } else if (key == "humidity") {
+                target = &humidity;
+            }
+        }
+        state = State::COLON;
+    }
+
+    // Um valor escalar terminou; números do campo alvo são convertidos aqui
+    void endScalar() {
+        if (state == State::NUMBER && target != nullptr) {
+            float number;
+            auto result = std::from_chars(token, token + std::min(tokenLength, MAX_TOKEN), number);
+            if (tokenLength > MAX_TOKEN || result.ec != std::errc() || result.ptr != token + tokenLength) {
+                state = State::FAILED;
+                return;
+            }
+            *target = number;
+            (target == &temperature ? hasTemperature : hasHumidity) = true;
+        }
+        mainNext = false;
+        target = nullptr;
+        state = depth == 0 ? State::DONE : State::AFTER_VALUE;
+    }
+
+    static bool isSpace(char c) {
+        return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+    }
+
+    static bool isNumberChar(char c) {
+        return (c >= '0' && c <= '9') || c == '-' || c == '+' || c == '.' || c == 'e' || c == 'E';
+    }
+
+    void step(char c) {
+        switch (state) {
+            case State::KEY_OR_END:
+                if (c == '}' && !afterComma) {
+                    close(true);
+                } else if (c == '"') {
+                    afterComma = false;
+                    tokenLength = 0;
+                    escaped = false;
+                    state = State::KEY;
+                } else if (!isSpace(c)) {
+                    state = State::FAILED;
+                }
+                return;
+            case State::AFTER_VALUE:
+                if (c == ',') {
+                    afterComma = true;
+                    state = isObject[depth - 1] ? State::KEY_OR_END : State::VALUE;
+                } else if (c == '}' || c == ']') {
+                    close(c == '}');
+                } else if (!isSpace(c)) {
+                    state = State::FAILED;
+                }
+                return;
+            case State::KEY:
+            case State::STRING:
+                if (escaped) {
+                    escaped = false;
+                    tokenLength = MAX_TOKEN + 1; // chaves com escape não casam
+                } else if (c == '\\') {
+                    escaped = true;
+                } else if (c == '"') {
+                    if (state == State::KEY) {
+                        endKey();
+                    } else {
+                        endScalar();
+                    }
+                } else if (state == State::KEY) {
+                    appendToken(c);
+                }
+                return;
+            case State::COLON:
+                if (c == ':') {
+                    state = State::VALUE;
+                } else if (!isSpace(c)) {
+                    state = State::FAILED;
+                }
+                return;
+            case State::VALUE:
+                if (isSpace(c)) {
+                    return;
+                }
+                if (c == ']' && !afterComma && depth > 0 && !isObject[depth - 1]) {
+                    close(false); // array vazio; ']' fora de um array ou após ',' cai em FAILED
+                    return;
+                }
+                afterComma = false;
+                if (c == '{' || c == '[') {
+                    open(c == '{');
+                } else if (c == '"') {
+                    escaped = false;
+                    state = State::STRING;
+                } else if (isNumberChar(c)) {
+                    tokenLength = 0;
+                    appendToken(c);
+                    state = State::NUMBER;
+                } else if (c == 't' || c == 'f' || c == 'n') {
+                    state = State::LITERAL;
+                } else {
+                    state = State::FAILED;
+                }
+                return;
+            case State::NUMBER:
+            case State::LITERAL:
+                if (state == State::NUMBER && isNumberChar(c)) {
+                    appendToken(c);
+                    return;
+                }
+                if (state == State::LITERAL && c >= 'a' && c <= 'z') {
+                    return;
+                }
+                endScalar();
+                if (state == State::AFTER_VALUE) {
+                    step(c); // o caractere que encerrou o valor ainda conta
+                } else if (state == State::DONE && !isSpace(c)) {
+                    state = State::FAILED;
+                }
+                return;
+            case State::DONE:
+            case State::FAILED:
+                return;
+        }
+    }
+
+public:
+    float temperature;
+    float humidity;
+
+    WeatherStreamParser() {
+        reset();
+    }
+
+    void reset() {
+        state = State::VALUE;
+        depth = 0;
+        afterComma = false;
+        escaped = false;
+        tokenLength = 0;
+        mainNext = false;
+        inMain = false;
+        target = nullptr;
+        hasTemperature = false;
+        hasHumidity = false;
+        temperature = 0.0f;
+        humidity = 0.0f;
+    }
+
+    void feed(const char* data, size_t size) {
+        for (size_t i = 0; i < size && state != State::DONE && state != State::FAILED; i++) {
+            step(data[i]);
+        }
+    }
+
+    bool complete() const {
+        return hasTemperature && hasHumidity;
+    }
+
+    bool failed() const {
+        return state == State::FAILED;
+    }
+};
+
+// Callback de escrita da libcurl: cada pedaço do corpo vai direto para o parser
+size_t WriteCallback(void* contents, size_t size, size_t nmemb, void* parserptr) {
+    ((WeatherStreamParser*)parserptr)->feed((const char*)contents, size * nmemb);
     return size * nmemb;
 }
-// Função para pegar os dados da API OpenWeatherMap
-std::string getWeatherData(const std::string& apiKey, const std::string& city, const std::string& country) {
+
+// Cliente HTTP persistente: o mesmo handle da libcurl é reaproveitado entre
+// as requisições, então a conexão TCP fica aberta (keep-alive) e o DNS fica
+// em cache. O corpo não é guardado: passa pelo WeatherStreamParser enquanto
+// chega. A libcurl precisa ter sido inicializada (curl_global_init) antes.
+class HttpClient {
+private:
     CURL* curl;
-    CURLcode res;
-    std::string readBuffer;
+    WeatherStreamParser parser;
+    char errorBuffer[CURL_ERROR_SIZE];
 
-    curl_global_init(CURL_GLOBAL_DEFAULT);
-    curl = curl_easy_init();
+public:
+    HttpClient() : curl(curl_easy_init()) {
+        errorBuffer[0] = '\0';
+        if (curl) {
+            curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, WriteCallback);
+            curl_easy_setopt(curl, CURLOPT_WRITEDATA, &parser);
+            curl_easy_setopt(curl, CURLOPT_ERRORBUFFER, errorBuffer);
+            curl_easy_setopt(curl, CURLOPT_TCP_KEEPALIVE, 1L);
+            curl_easy_setopt(curl, CURLOPT_DNS_CACHE_TIMEOUT, (long)HTTP_DNS_CACHE_SECONDS);
+            curl_easy_setopt(curl, CURLOPT_CONNECTTIMEOUT_MS, (long)HTTP_CONNECT_TIMEOUT_MS);
+            curl_easy_setopt(curl, CURLOPT_TIMEOUT_MS, (long)HTTP_TIMEOUT_MS);
+            curl_easy_setopt(curl, CURLOPT_NOSIGNAL, 1L);
+        }
+    }
+
+    HttpClient(const HttpClient&) = delete;
+    HttpClient& operator=(const HttpClient&) = delete;
+
+    ~HttpClient() {
+        if (curl) {
+            curl_easy_cleanup(curl);
+        }
+    }
+
+    CURL* handle() const {
+        return curl;
+    }
 
-    //verifica a inicialização do manipulador
-    if (curl) {
-        std::string url = "http://api.openweathermap.org/data/2.5/weather?q=" + city + "," + country + "&appid=" + apiKey + "&units=metric";
+    // Prepara um GET; usado direto por get() ou pelo MultiPoller
+    bool prepare(const std::string& url) {
+        parser.reset();
+        if (!curl) {
+            std::cerr << "CURL handle not initialized" << std::endl;
+            return false;
+        }
         curl_easy_setopt(curl, CURLOPT_URL, url.c_str());
-        curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, WriteCallback);
-        curl_easy_setopt(curl, CURLOPT_WRITEDATA, &readBuffer);
-        
-        res = curl_easy_perform(curl);
-        
+        return true;
+    }
+
+    // Confere o resultado de uma transferência preparada com prepare()
+    bool finish(CURLcode res) {
         if (res != CURLE_OK) {
-            std::cerr << "CURL request failed: " << curl_easy_strerror(res) << std::endl;
+            std::cerr << "CURL request failed: " << (errorBuffer[0] ? errorBuffer : curl_easy_strerror(res)) << std::endl;
+            errorBuffer[0] = '\0';
+            return false;
+        }
+
+        long status = 0;
+        curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &status);
+        if (status >= 400) {
+            const char* url = nullptr;
+            curl_easy_getinfo(curl, CURLINFO_EFFECTIVE_URL, &url);
+            std::cerr << "HTTP request failed with status " << status << ": " << (url ? url : "") << std::endl;
+            return false;
+        }
+        // Um corpo que quebra depois de main.temp/main.humidity também é recusado
+        if (parser.failed() || !parser.complete()) {
+            const char* url = nullptr;
+            curl_easy_getinfo(curl, CURLINFO_EFFECTIVE_URL, &url);
+            std::cerr << "Error parsing JSON: " << (parser.failed() ? "invalid response" : "missing main.temp or main.humidity")
+                      << " from " << (url ? url : "") << std::endl;
+            return false;
         }
+        return true;
+    }
 
-        curl_easy_cleanup(curl);
+    // Faz um GET; a leitura fica em reading() até a próxima chamada
+    bool get(const std::string& url) {
+        return prepare(url) && finish(curl_easy_perform(curl));
     }
 
-    //finaliza a biblioteca cURL
-    curl_global_cleanup();
-    //testa readBUFFER
-    //std::cout << readBuffer << std::endl;
-    return readBuffer;
+    const WeatherStreamParser& reading() const {
+        return parser;
+    }
+};
+
+// Monta a URL da API OpenWeatherMap para uma cidade
+std::string weatherUrl(const std::string& baseUrl, const std::string& apiKey, const std::string& city, const std::string& country) {
+    return baseUrl + "?q=" + city + "," + country + "&appid=" + apiKey + "&units=metric";
+}
+
+// Fonte de dados do coletor: cada uma publica como uma máquina própria
+struct WeatherSource {
+    std::string machineId;
+    std::string url;
+    // Tópicos de publicação, montados uma vez por fonte
+    std::string temperatureTopic;
+    std::string humidityTopic;
+};
+
+// Lê "<machine_id>=<cidade>,<país>" ou "<machine_id>=<url>"
+bool parseWeatherSource(const std::string& spec, const std::string& apiUrl, WeatherSource& source) {
+    size_t equals = spec.find('=');
+    if (equals == std::string::npos || equals == 0 || equals + 1 == spec.size() ||
+        spec.find('/') < equals) {
+        return false;
+    }
+    source.machineId = spec.substr(0, equals);
+    source.temperatureTopic = "/sensors/" + source.machineId + "/" + SENSOR_ID_TEMPERATURE;
+    source.humidityTopic = "/sensors/" + source.machineId + "/" + SENSOR_ID_HUMIDITY;
+    std::string target = spec.substr(equals + 1);
+    if (target.rfind("http://", 0) == 0 || target.rfind("https://", 0) == 0) {
+        source.url = target;
+        return true;
+    }
+    size_t comma = target.rfind(',');
+    if (comma == std::string::npos || comma == 0 || comma + 1 == target.size()) {
+        return false;
+    }
+    char* city = curl_easy_escape(nullptr, target.c_str(), (int)comma);
+    source.url = weatherUrl(apiUrl, WEATHER_API_KEY, city, target.substr(comma + 1));
+    curl_free(city);
+    return true;
+}
+
+// O que fazer quando uma fonte perde o próprio prazo (a requisição anterior
+// ainda não terminou ou o loop atrasou mais de um período)
+enum class OverrunPolicy {
+    CATCH_UP, // dispara as amostras atrasadas em sequência até alcançar o relógio
+    SKIP      // pula os períodos perdidos e volta para a grade de prazos
+};
+
+bool parseOverrunPolicy(const std::string& name, OverrunPolicy& policy) {
+    if (name == "catch-up") {
+        policy = OverrunPolicy::CATCH_UP;
+    } else if (name == "skip") {
+        policy = OverrunPolicy::SKIP;
+    } else {
+        return false;
+    }
+    return true;
 }
 
-// Função para processar os dados JSON e extrair temperatura e umidade
-void processWeatherData(const std::string& data, float& temperature, float& humidity) {
+// Histograma de desvios de tempo em faixas de potência de 2 (em µs)
+class JitterHistogram {
+private:
+    static const int BUCKETS = 32;
+    std::array<uint64_t, BUCKETS> buckets{};
+    uint64_t count = 0;
+    int64_t maxUs = 0;
+
+    // Limite superior da faixa que contém o percentil p
+    int64_t percentile(double p) const {
+        uint64_t target = (uint64_t)(p * (count - 1)) + 1;
+        uint64_t seen = 0;
+        for (int b = 0; b < BUCKETS; b++) {
+            seen += buckets[b];
+            if (seen >= target) {
+                return (int64_t)1 << b;
+            }
+        }
+        return maxUs;
+    }
+
+public:
+    void record(std::chrono::steady_clock::duration deviation) {
+        int64_t us = std::chrono::duration_cast<std::chrono::microseconds>(deviation).count();
+        if (us < 0) {
+            us = -us;
+        }
+        int bucket = 0;
+        while (bucket < BUCKETS - 1 && ((int64_t)1 << bucket) <= us) {
+            bucket++;
+        }
+        buckets[bucket]++;
+        count++;
+        maxUs = std::max(maxUs, us);
+    }
+
+    void print(const std::string& name) const {
+        std::cout << name << ": n=" << count;
+        if (count > 0) {
+            std::cout << " p50<" << percentile(0.5) << "us p99<" << percentile(0.99)
+                      << "us max=" << maxUs << "us";
+        }
+        std::cout << std::endl;
+    }
+
+    void reset() {
+        buckets.fill(0);
+        count = 0;
+        maxUs = 0;
+    }
+};
+
+// Consulta as fontes com a interface multi da libcurl, em uma única thread.
+// Cada fonte dispara em prazos absolutos do steady_clock (início + fase +
+// k * período), então o tempo das requisições não acumula deriva. As fases
+// espalham as fontes ao longo do período para não disparar tudo junto.
+// Cada fonte tem seu HttpClient (handle e buffer reaproveitados); as
+// conexões ficam no cache do multi handle. Cada resposta é entregue assim
+// que chega.
+class MultiPoller {
+private:
+    using Clock = std::chrono::steady_clock;
+    using Deadline = std::pair<Clock::time_point, size_t>;
+
+    CURLM* multi;
+    std::vector<WeatherSource> sources;
+    std::vector<std::unique_ptr<HttpClient>> clients;
+    std::chrono::nanoseconds interval;
+    OverrunPolicy policy;
+
+    std::priority_queue<Deadline, std::vector<Deadline>, std::greater<Deadline>> due;
+    std::vector<bool> inFlight;
+    std::vector<Clock::time_point> deferred;     // CATCH_UP: prazo que esperava a requisição anterior
+    std::vector<Clock::time_point> lastResponse;
+    int running = 0;
+
+    JitterHistogram startJitter;  // atraso do disparo em relação ao prazo
+    JitterHistogram periodJitter; // desvio entre respostas consecutivas e o período
+    uint64_t overruns = 0;
+    uint64_t skipped = 0;
+
+    void start(size_t index) {
+        if (clients[index]->prepare(sources[index].url)) {
+            curl_multi_add_handle(multi, clients[index]->handle());
+            inFlight[index] = true;
+            running++;
+        }
+    }
+
+    // Dispara as fontes cujo prazo já chegou e agenda o próximo prazo
+    void fireDue(Clock::time_point now) {
+        while (!due.empty() && due.top().first <= now) {
+            Clock::time_point deadline = due.top().first;
+            size_t index = due.top().second;
+            due.pop();
+
+            Clock::time_point next = deadline + interval;
+            if (inFlight[index]) {
+                overruns++;
+                if (policy == OverrunPolicy::CATCH_UP) {
+                    deferred[index] = deadline; // dispara quando a anterior terminar
+                    continue;
+                }
+                skipped++;
+            } else {
+                start(index);
+                startJitter.record(now - deadline);
+            }
+            if (policy == OverrunPolicy::SKIP) {
+                while (next <= now) {
+                    next += interval;
+                    skipped++;
+                }
+            }
+            due.push({next, index});
+        }
+    }
+
+    template <typename Callback>
+    void collect(Callback& onResponse) {
+        int queued = 0;
+        while (CURLMsg* msg = curl_multi_info_read(multi, &queued)) {
+            if (msg->msg != CURLMSG_DONE) {
+                continue;
+            }
+            void* privateData = nullptr;
+            curl_easy_getinfo(msg->easy_handle, CURLINFO_PRIVATE, &privateData);
+            size_t index = (size_t)privateData;
+            CURLcode result = msg->data.result;
+            curl_multi_remove_handle(multi, msg->easy_handle);
+            inFlight[index] = false;
+            running--;
+
+            if (clients[index]->finish(result)) {
+                Clock::time_point now = Clock::now();
+                if (lastResponse[index] != Clock::time_point()) {
+                    periodJitter.record(now - lastResponse[index] - interval);
+                }
+                lastResponse[index] = now;
+                onResponse(sources[index], clients[index]->reading());
+            }
+            if (deferred[index] != Clock::time_point()) {
+                due.push({deferred[index], index});
+                deferred[index] = Clock::time_point();
+            }
+        }
+    }
+
+    void printStats() {
+        startJitter.print("SCHEDULER start lateness");
+        periodJitter.print("SCHEDULER period jitter");
+        std::cout << "SCHEDULER overruns=" << overruns << " skipped=" << skipped << std::endl;
+        startJitter.reset();
+        periodJitter.reset();
+    }
+
+public:
+    MultiPoller(const std::vector<WeatherSource>& weatherSources, std::chrono::nanoseconds period, OverrunPolicy overrun)
+        : multi(curl_multi_init()), sources(weatherSources), interval(period), policy(overrun),
+          inFlight(sources.size(), false), deferred(sources.size()), lastResponse(sources.size()) {
+        curl_multi_setopt(multi, CURLMOPT_MAX_TOTAL_CONNECTIONS, (long)HTTP_MAX_CONNECTIONS);
+        curl_multi_setopt(multi, CURLMOPT_MAXCONNECTS, (long)HTTP_MAX_CONNECTIONS);
+        for (size_t i = 0; i < sources.size(); i++) {
+            clients.emplace_back(new HttpClient());
+            curl_easy_setopt(clients[i]->handle(), CURLOPT_PRIVATE, (void*)i);
+        }
+    }
+
+    MultiPoller(const MultiPoller&) = delete;
+    MultiPoller& operator=(const MultiPoller&) = delete;
+
+    ~MultiPoller() {
+        for (const std::unique_ptr<HttpClient>& client : clients) {
+            curl_multi_remove_handle(multi, client->handle());
+        }
+        curl_multi_cleanup(multi);
+    }
+
+    // Roda até keepRunning ficar false, chamando onResponse(fonte, leitura)
+    // para cada resposta bem-sucedida. As requisições em andamento terminam
+    // antes de retornar.
+    template <typename Callback>
+    void run(const std::atomic<bool>& keepRunning, Callback&& onResponse) {
+        const Clock::time_point begin = Clock::now();
+        for (size_t i = 0; i < sources.size(); i++) {
+            due.push({begin + interval * i / sources.size(), i});
+        }
+        Clock::time_point nextStats = begin + std::chrono::seconds(SCHEDULER_STATS_INTERVAL);
+
+        while (keepRunning || running > 0) {
+            Clock::time_point now = Clock::now();
+            if (keepRunning) {
+                fireDue(now);
+            }
+
+            int still = 0;
+            CURLMcode mc = curl_multi_perform(multi, &still);
+            collect(onResponse);
+
+            if (now >= nextStats) {
+                printStats();
+                nextStats += std::chrono::seconds(SCHEDULER_STATS_INTERVAL);
+            }
+
+            // Dorme até o próximo prazo ou até algum socket ter dados
+            int timeoutMs = 1000;
+            if (keepRunning && !due.empty()) {
+                auto wait = std::chrono::duration_cast<std::chrono::microseconds>(due.top().first - Clock::now());
+                timeoutMs = (int)std::max<int64_t>(0, std::min<int64_t>(1000, (wait.count() + 999) / 1000));
+            }
+            if (mc == CURLM_OK) {
+                mc = curl_multi_poll(multi, nullptr, 0, timeoutMs, nullptr);
+            }
+            if (mc != CURLM_OK) {
+                std::cerr << "CURL multi failed: " << curl_multi_strerror(mc) << std::endl;
+                std::this_thread::sleep_for(std::chrono::milliseconds(timeoutMs));
+            }
+        }
+        printStats();
+    }
+};
 
-    Json::CharReaderBuilder reader;
-    Json::Value root;
-    std::istringstream s(data);
-    std::string errs;
+// Codificação das mensagens de leitura e de anúncio (--encoding). Em CBOR
+// (RFC 8949) uma leitura é o mapa {0: timestamp em ns, 1: valor float32};
+// o anúncio leva "encoding": "cbor" para o processador saber o que esperar.
+enum class WireEncoding {
+    JSON,
+    CBOR
+};
 
-    if (Json::parseFromStream(reader, s, &root, &errs)) {
-        temperature = root["main"]["temp"].asFloat();
-        humidity = root["main"]["humidity"].asFloat();
+bool parseWireEncoding(const std::string& name, WireEncoding& encoding) {
+    if (name == "json") {
+        encoding = WireEncoding::JSON;
+    } else if (name == "cbor") {
+        encoding = WireEncoding::CBOR;
     } else {
-        std::cerr << "Error parsing JSON: " << errs << std::endl;
+        return false;
+    }
+    return true;
+}
+
+const uint8_t CBOR_READING_KEY_TIMESTAMP = 0;
+const uint8_t CBOR_READING_KEY_VALUE = 1;
+const size_t CBOR_READING_MAX_BYTES = 32; // uma leitura ocupa 17 bytes
+const size_t JSON_READING_MAX_BYTES = 96;  // {"timestamp":"<20>","value":<até 15>}
+
+// Escreve itens CBOR em um buffer do chamador, sem alocar. Se o buffer
+// acabar, ok() passa a retornar false e o resto é ignorado.
+class CborWriter {
+private:
+    uint8_t* pos;
+    uint8_t* end;
+    bool overflow = false;
+
+    void put(const uint8_t* bytes, size_t count) {
+        if (overflow || (size_t)(end - pos) < count) {
+            overflow = true;
+            return;
+        }
+        std::memcpy(pos, bytes, count);
+        pos += count;
+    }
+
+    // Cabeçalho com o menor tamanho de argumento possível
+    void header(uint8_t major, uint64_t argument) {
+        uint8_t bytes[9];
+        size_t count;
+        if (argument < 24) {
+            bytes[0] = (uint8_t)(major << 5 | argument);
+            count = 1;
+        } else {
+            int width = argument <= 0xff ? 1 : argument <= 0xffff ? 2 : argument <= 0xffffffff ? 4 : 8;
+            bytes[0] = (uint8_t)(major << 5 | (width == 1 ? 24 : width == 2 ? 25 : width == 4 ? 26 : 27));
+            for (int i = 0; i < width; i++) {
+                bytes[1 + i] = (uint8_t)(argument >> (8 * (width - 1 - i)));
+            }
+            count = 1 + width;
+        }
+        put(bytes, count);
     }
+
+public:
+    CborWriter(uint8_t* buffer, size_t capacity)
+        : pos(buffer), end(buffer + capacity) {}
+
+    void map(size_t entries) {
+        header(5, entries);
+    }
+
+    void integer(int64_t value) {
+        if (value >= 0) {
+            header(0, (uint64_t)value);
+        } else {
+            header(1, (uint64_t)(-1 - value));
+        }
+    }
+
+    void float32(float value) {
+        uint32_t bits;
+        std::memcpy(&bits, &value, sizeof(bits));
+        uint8_t bytes[5] = {0xfa, (uint8_t)(bits >> 24), (uint8_t)(bits >> 16), (uint8_t)(bits >> 8), (uint8_t)bits};
+        put(bytes, sizeof(bytes));
+    }
+
+    bool ok() const {
+        return !overflow;
+    }
+
+    uint8_t* position() const {
+        return pos;
+    }
+};
+
+// Retorna o tamanho da leitura codificada, ou 0 se não couber no buffer
+size_t encodeReadingCBOR(uint8_t* buffer, size_t capacity, Timestamp timestamp, float value) {
+    uint8_t* begin = buffer;
+    CborWriter writer(buffer, capacity);
+    writer.map(2);
+    writer.integer(CBOR_READING_KEY_TIMESTAMP);
+    writer.integer(timestamp);
+    writer.integer(CBOR_READING_KEY_VALUE);
+    writer.float32(value);
+    return writer.ok() ? (size_t)(writer.position() - begin) : 0;
 }
 
-void publishInitialMessage(mqtt::async_client& client) {
-    Json::Value root;
-    root["machine_id"] = MACHINE_ID;
+void publishInitialMessage(mqtt::async_client& client, const std::string& machineId, WireEncoding encoding) {
+    json root;
+    root["machine_id"] = machineId;
     
-    Json::Value sensor1;
+    json sensor1;
     sensor1["sensor_id"] = SENSOR_ID_TEMPERATURE;
     sensor1["data_type"] = "float";
     sensor1["data_interval"] = DATA_INTERVAL;
 
-    Json::Value sensor2;
+    json sensor2;
     sensor2["sensor_id"] = SENSOR_ID_HUMIDITY;
     sensor2["data_type"] = "float";
     sensor2["data_interval"] = DATA_INTERVAL;
@@ -94,59 +820,511 @@ void publishInitialMessage(mqtt::async_client& client) {
     root["sensors"][0] = sensor1;
     root["sensors"][1] = sensor2;
 
-    Json::StreamWriterBuilder writer;
-    std::string message = Json::writeString(writer, root);
-    std::cout << message << std::endl;
-    mqtt::message_ptr msg = mqtt::make_message("/sensor_monitors", message);
+    mqtt::message_ptr msg;
+    if (encoding == WireEncoding::CBOR) {
+        root["encoding"] = "cbor";
+        std::vector<uint8_t> message = json::to_cbor(root);
+        std::cout << machineId << ": announced with CBOR encoding" << std::endl;
+        msg = mqtt::make_message("/sensor_monitors", message.data(), message.size());
+    } else {
+        std::string message = root.dump(1, '\t');
+        std::cout << message << std::endl;
+        msg = mqtt::make_message("/sensor_monitors", message);
+    }
     client.publish(msg)->wait_for(std::chrono::seconds(10));
 }
 
+// Publica mensagens MQTT de forma assíncrona, sem esperar o round trip do
+// broker a cada leitura. O loop de amostragem só enfileira; uma thread
+// dedicada mantém até PUBLISH_MAX_INFLIGHT publicações em andamento e
+// trata as confirmações pelo iaction_listener. Falhas voltam para a fila
+// com backoff exponencial até PUBLISH_MAX_RETRIES tentativas. Se a fila
+// encher (broker fora do ar), as leituras mais antigas são descartadas.
+// O listener de cada publicação é o próprio Pending, que segura o estado
+// da fila por um shared_ptr: uma confirmação que a paho entregue depois de
+// stop(), ou depois de o AsyncPublisher ser destruído, só mexe no Pending e
+// nesse estado.
+class AsyncPublisher {
+public:
+    struct Stats {
+        uint64_t published = 0;
+        uint64_t retried = 0;
+        uint64_t failed = 0;
+        uint64_t dropped = 0;
+    };
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    struct Pending;
+
+    // Fila e contadores, compartilhados com as publicações em andamento
+    struct State {
+        std::mutex mutex;
+        std::condition_variable wakeup;  // acorda a thread de publicação
+        std::condition_variable drained; // acorda stop() quando algo termina
+        std::deque<Pending*> ready;                         // aguardando espaço na janela
+        std::multimap<Clock::time_point, Pending*> retries; // aguardando o backoff
+        size_t inflight = 0;
+        bool stopping = false;
+        bool abandoned = false; // stop() desistiu de esperar o broker
+        Stats counters;
+
+        // Chamado com o mutex travado
+        bool idle() const {
+            return ready.empty() && retries.empty() && inflight == 0;
+        }
+
+        // Reagenda uma publicação que falhou ou a descarta de vez. Chamado com
+        // o mutex travado, por quem ainda segura uma referência ao estado
+        void retry(Pending* pending) {
+            if (abandoned) {
+                delete pending;
+            } else if (++pending->attempts > PUBLISH_MAX_RETRIES) {
+                std::cerr << "Publish failed after " << PUBLISH_MAX_RETRIES << " retries: "
+                          << pending->msg->get_topic() << std::endl;
+                counters.failed++;
+                delete pending;
+            } else {
+                auto backoff = std::chrono::milliseconds(PUBLISH_RETRY_BACKOFF_MS << (pending->attempts - 1));
+                retries.emplace(Clock::now() + backoff, pending);
+                counters.retried++;
+            }
+        }
+    };
+
+    struct Pending : mqtt::iaction_listener {
+        std::shared_ptr<State> state;
+        mqtt::message_ptr msg;
+        int attempts = 0;
+
+        Pending(std::shared_ptr<State> sharedState, mqtt::message_ptr message)
+            : state(std::move(sharedState)), msg(std::move(message)) {}
+
+        void on_success(const mqtt::token&) override {
+            complete(true);
+        }
+
+        void on_failure(const mqtt::token&) override {
+            complete(false);
+        }
+
+        // Pode apagar este Pending; a cópia local mantém o estado vivo até o
+        // fim, mesmo que este fosse o último dono
+        void complete(bool success) {
+            std::shared_ptr<State> shared = state;
+            std::lock_guard<std::mutex> lock(shared->mutex);
+            shared->inflight--;
+            if (shared->abandoned) {
+                delete this; // já contada em dropped por stop()
+            } else if (success) {
+                shared->counters.published++;
+                delete this;
+            } else {
+                shared->retry(this);
+            }
+            shared->drained.notify_all();
+            shared->wakeup.notify_one();
+        }
+    };
+
+    mqtt::async_client& client;
+    std::shared_ptr<State> state;
+    std::thread worker;
+
+    void run() {
+        State& shared = *state;
+        std::unique_lock<std::mutex> lock(shared.mutex);
+        while (true) {
+            // Retentativas cujo backoff venceu voltam para a frente da fila
+            Clock::time_point now = Clock::now();
+            while (!shared.retries.empty() && shared.retries.begin()->first <= now) {
+                shared.ready.push_front(shared.retries.begin()->second);
+                shared.retries.erase(shared.retries.begin());
+            }
+
+            if (!shared.ready.empty() && shared.inflight < PUBLISH_MAX_INFLIGHT) {
+                Pending* pending = shared.ready.front();
+                shared.ready.pop_front();
+                shared.inflight++;
+                lock.unlock();
+                try {
+                    client.publish(pending->msg, nullptr, *pending);
+                } catch (const mqtt::exception& e) {
+                    std::cerr << "Publish error: " << e.what() << std::endl;
+                    lock.lock();
+                    shared.inflight--;
+                    shared.retry(pending);
+                    continue;
+                }
+                lock.lock();
+                continue;
+            }
+
+            if (shared.stopping && (shared.idle() || shared.abandoned)) {
+                break;
+            }
+            if (shared.retries.empty()) {
+                shared.wakeup.wait(lock);
+            } else {
+                shared.wakeup.wait_until(lock, shared.retries.begin()->first);
+            }
+        }
+    }
+
+public:
+    explicit AsyncPublisher(mqtt::async_client& mqttClient)
+        : client(mqttClient), state(std::make_shared<State>()) {
+        worker = std::thread(&AsyncPublisher::run, this);
+    }
+
+    AsyncPublisher(const AsyncPublisher&) = delete;
+    AsyncPublisher& operator=(const AsyncPublisher&) = delete;
+
+    ~AsyncPublisher() {
+        stop();
+    }
+
+    // Enfileira sem bloquear; retorna false se precisou descartar a mais
+    // antiga. Aloca o Pending e a mqtt::message (cópia do payload).
+    bool publish(const std::string& topic, std::string_view payload) {
+        Pending* pending = new Pending(state, mqtt::make_message(topic, payload.data(), payload.size()));
+        Pending* evicted = nullptr;
+        {
+            std::lock_guard<std::mutex> lock(state->mutex);
+            if (state->ready.size() >= PUBLISH_QUEUE_CAPACITY) {
+                evicted = state->ready.front();
+                state->ready.pop_front();
+                state->counters.dropped++;
+            }
+            state->ready.push_back(pending);
+        }
+        state->wakeup.notify_one();
+        delete evicted;
+        return evicted == nullptr;
+    }
+
+    Stats stats() {
+        std::lock_guard<std::mutex> lock(state->mutex);
+        return state->counters;
+    }
+
+    // Espera a fila esvaziar (no máximo PUBLISH_DRAIN_TIMEOUT_MS) e encerra a thread
+    void stop() {
+        if (!worker.joinable()) {
+            return;
+        }
+        {
+            std::unique_lock<std::mutex> lock(state->mutex);
+            state->stopping = true;
+            state->wakeup.notify_one();
+            Clock::time_point limit = Clock::now() + std::chrono::milliseconds(PUBLISH_DRAIN_TIMEOUT_MS);
+            state->drained.wait_until(lock, limit, [this] { return state->idle(); });
+            // O que não saiu a tempo é descartado; confirmações que ainda
+            // chegarem só apagam o próprio Pending
+            state->abandoned = true;
+            for (Pending* pending : state->ready) {
+                delete pending;
+            }
+            for (auto& entry : state->retries) {
+                delete entry.second;
+            }
+            state->counters.dropped += state->ready.size() + state->retries.size() + state->inflight;
+            state->ready.clear();
+            state->retries.clear();
+        }
+        state->wakeup.notify_one();
+        worker.join();
+    }
+};
+
+// Serializa uma leitura como JSON compacto {"timestamp":"...","value":...}
+// em um buffer fixo, sem alocar; o valor sai com std::to_chars na menor
+// representação que volta ao mesmo float. A view devolvida vale até a
+// próxima chamada. Só a codificação é livre de alocação (conferido por
+// bench/collector_alloc_test.cpp): publicar ainda aloca o Pending, a
+// mqtt::message com a cópia do payload e o que a paho aloca por mensagem.
+class ReadingSerializer {
+private:
+    std::array<char, JSON_READING_MAX_BYTES> buffer;
+
+    char* append(char* pos, std::string_view text) {
+        std::memcpy(pos, text.data(), text.size());
+        return pos + text.size();
+    }
+
+public:
+    std::string_view serialize(Timestamp timestamp, float value) {
+        char* pos = buffer.data();
+        pos = append(pos, "{\"timestamp\":\"");
+        pos += formatTimestamp(timestamp, pos);
+        pos = append(pos, "\",\"value\":");
+        if (std::isfinite(value)) {
+            pos = std::to_chars(pos, buffer.data() + buffer.size() - 1, value).ptr;
+        } else {
+            pos = append(pos, "null"); // JSON não tem NaN/infinito
+        }
+        *pos++ = '}';
+        return std::string_view(buffer.data(), pos - buffer.data());
+    }
+};
+
+// Publica temperatura e umidade como a máquina da fonte
+void publishWeatherReading(AsyncPublisher& publisher, const WeatherSource& source, float temperature, float humidity, WireEncoding encoding) {
+    // As duas leituras da amostra compartilham o mesmo instante
+    const Timestamp now = currentTimestamp();
+
+    const std::string& machineId = source.machineId;
+    if (encoding == WireEncoding::CBOR) {
+        uint8_t tempMessage[CBOR_READING_MAX_BYTES];
+        uint8_t humMessage[CBOR_READING_MAX_BYTES];
+        size_t tempSize = encodeReadingCBOR(tempMessage, sizeof(tempMessage), now, temperature);
+        size_t humSize = encodeReadingCBOR(humMessage, sizeof(humMessage), now, humidity);
+        std::cout << machineId << " temperature: " << temperature << " umidity: " << humidity
+                  << " (CBOR, " << tempSize << "+" << humSize << " bytes)" << std::endl;
+        publisher.publish(source.temperatureTopic, std::string_view((const char*)tempMessage, tempSize));
+        publisher.publish(source.humidityTopic, std::string_view((const char*)humMessage, humSize));
+        return;
+    }
+
+    // publish() copia o payload, então o mesmo buffer serve às duas leituras
+    thread_local ReadingSerializer serializer;
+    std::string_view tempMessage = serializer.serialize(now, temperature);
+    std::cout << machineId << " temperature: " << tempMessage << std::endl;
+    publisher.publish(source.temperatureTopic, tempMessage);
+    std::string_view humMessage = serializer.serialize(now, humidity);
+    std::cout << "umidity: " << humMessage << std::endl;
+    publisher.publish(source.humidityTopic, humMessage);
+    
+    std::cout << "Queued temperature and humidity. "<< std::endl;
+}
+
+// Agrupa leituras de várias máquinas e sensores em uma única mensagem no
+// SENSOR_BATCH_TOPIC, para diluir o custo por mensagem do broker e do TCP.
+// O lote sai quando atinge MESSAGE_BATCH_MAX_READINGS leituras ou
+// MESSAGE_BATCH_MAX_BYTES (estimados), ou quando a leitura mais antiga
+// espera MESSAGE_BATCH_MAX_LATENCY_MS.
+class ReadingBatcher {
+private:
+    struct Reading {
+        std::string machineId;
+        std::string sensorId;
+        Timestamp timestamp;
+        float value;
+    };
+
+    AsyncPublisher& publisher;
+    std::mutex mutex;
+    std::condition_variable wakeup;
+    std::vector<Reading> readings;
+    size_t estimatedBytes = 0;
+    std::chrono::steady_clock::time_point oldest;
+    bool stopping = false;
+    std::thread worker;
+
+    // Chamado com o mutex travado
+    void flush() {
+        if (readings.empty()) {
+            return;
+        }
+        json root;
+        root["schema_version"] = SENSOR_BATCH_SCHEMA_VERSION;
+        json& list = root["readings"];
+        for (const Reading& reading : readings) {
+            list.push_back({
+                {"machine_id", reading.machineId},
+                {"sensor_id", reading.sensorId},
+                {"timestamp", reading.timestamp},
+                {"value", reading.value},
+            });
+        }
+        publisher.publish(SENSOR_BATCH_TOPIC, root.dump());
+        readings.clear();
+        estimatedBytes = 0;
+    }
+
+    void run() {
+        std::unique_lock<std::mutex> lock(mutex);
+        while (!stopping) {
+            if (readings.empty()) {
+                wakeup.wait(lock);
+            } else if (wakeup.wait_until(lock, oldest + std::chrono::milliseconds(MESSAGE_BATCH_MAX_LATENCY_MS)) == std::cv_status::timeout) {
+                flush();
+            }
+        }
+        flush();
+    }
+
+public:
+    explicit ReadingBatcher(AsyncPublisher& readingPublisher)
+        : publisher(readingPublisher) {
+        readings.reserve(MESSAGE_BATCH_MAX_READINGS);
+        worker = std::thread(&ReadingBatcher::run, this);
+    }
+
+    ReadingBatcher(const ReadingBatcher&) = delete;
+    ReadingBatcher& operator=(const ReadingBatcher&) = delete;
+
+    ~ReadingBatcher() {
+        stop();
+    }
+
+    void add(const std::string& machineId, const std::string& sensorId, Timestamp timestamp, float value) {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (readings.empty()) {
+            oldest = std::chrono::steady_clock::now();
+            wakeup.notify_one();
+        }
+        readings.push_back({machineId, sensorId, timestamp, value});
+        // Chaves, aspas e números de uma leitura somam ~90 bytes além dos ids
+        estimatedBytes += machineId.size() + sensorId.size() + 90;
+        if (readings.size() >= MESSAGE_BATCH_MAX_READINGS || estimatedBytes >= MESSAGE_BATCH_MAX_BYTES) {
+            flush();
+        }
+    }
+
+    // Publica o que estiver pendente e encerra a thread
+    void stop() {
+        if (!worker.joinable()) {
+            return;
+        }
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        wakeup.notify_one();
+        worker.join();
+    }
+};
+
+// Adiciona temperatura e umidade ao lote
+void batchWeatherReading(ReadingBatcher& batcher, const std::string& machineId, float temperature, float humidity) {
+    const Timestamp timestamp = currentTimestamp();
+    batcher.add(machineId, SENSOR_ID_TEMPERATURE, timestamp, temperature);
+    batcher.add(machineId, SENSOR_ID_HUMIDITY, timestamp, humidity);
+}
+
+// Os benchmarks (bench/collector_bench.cpp) incluem este arquivo sem o main
+#ifndef DATA_COLLECTOR_NO_MAIN
+void handleSignal(int) {
+    keepRunning = false;
+}
+
 int main(int argc, char* argv[]) {
+    // Fontes: --source=<machine_id>=<cidade>,<país> ou --source=<machine_id>=<url>,
+    // repetido ou em um arquivo com uma fonte por linha (--sources=<arquivo>).
+    // --api-url=<url> troca a URL base da API (ex.: servidor HTTP local).
+    // --overrun=skip|catch-up escolhe o que fazer com prazos perdidos.
+    // --batch publica as leituras em lotes no SENSOR_BATCH_TOPIC.
+    // --encoding=json|cbor escolhe a codificação das leituras e do anúncio
+    // (cbor não vale com --batch).
+
+    std::string apiUrl = WEATHER_API_URL;
+    OverrunPolicy overrun = OverrunPolicy::SKIP;
+    WireEncoding encoding = WireEncoding::JSON;
+    bool batch = false;
+    std::vector<std::string> sourceSpecs;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg.rfind("--api-url=", 0) == 0) {
+            apiUrl = arg.substr(10);
+        } else if (arg.rfind("--overrun=", 0) == 0) {
+            if (!parseOverrunPolicy(arg.substr(10), overrun)) {
+                std::cerr << "Unknown overrun policy: " << arg.substr(10) << " (use skip or catch-up)" << std::endl;
+                return -1;
+            }
+        } else if (arg.rfind("--encoding=", 0) == 0) {
+            if (!parseWireEncoding(arg.substr(11), encoding)) {
+                std::cerr << "Unknown encoding: " << arg.substr(11) << " (use json or cbor)" << std::endl;
+                return -1;
+            }
+        } else if (arg == "--batch") {
+            batch = true;
+        } else if (arg.rfind("--source=", 0) == 0) {
+            sourceSpecs.push_back(arg.substr(9));
+        } else if (arg.rfind("--sources=", 0) == 0) {
+            std::ifstream file(arg.substr(10));
+            if (!file) {
+                std::cerr << "Error opening sources file " << arg.substr(10) << std::endl;
+                return -1;
+            }
+            std::string line;
+            while (std::getline(file, line)) {
+                if (!line.empty() && line[0] != '#') {
+                    sourceSpecs.push_back(line);
+                }
+            }
+        }
+    }
+    // O lote (SENSOR_BATCH_TOPIC) só tem formato JSON
+    if (batch && encoding == WireEncoding::CBOR) {
+        std::cerr << "--batch publishes JSON batches and cannot be combined with --encoding=cbor" << std::endl;
+        return -1;
+    }
+    if (sourceSpecs.empty()) {
+        sourceSpecs.push_back(MACHINE_ID + "=Belo Horizonte,BR");
+        //sourceSpecs.push_back("machine_02=Calama,CL");
+        //sourceSpecs.push_back("machine_03=Sidney,AUS");
+        //sourceSpecs.push_back("machine_04=Beijing,CN");
+        //sourceSpecs.push_back("machine_05=London,GB");
+    }
+
+    // A libcurl é inicializada uma única vez, antes de qualquer thread
+    curl_global_init(CURL_GLOBAL_DEFAULT);
+
+    std::vector<WeatherSource> sources;
+    for (const std::string& spec : sourceSpecs) {
+        WeatherSource source;
+        if (!parseWeatherSource(spec, apiUrl, source)) {
+            std::cerr << "Invalid source: " << spec << std::endl;
+            return -1;
+        }
+        sources.push_back(source);
+    }
+    MultiPoller poller(sources, std::chrono::seconds(DATA_INTERVAL), overrun);
 
     mqtt::async_client client(SERVER_ADDRESS, CLIENT_ID);
     mqtt::connect_options connOpts;
+    connOpts.set_max_inflight((int)PUBLISH_MAX_INFLIGHT);
     mqtt::token_ptr conntok = client.connect(connOpts);
     conntok->wait();
 
-    publishInitialMessage(client);
-
-    while (true) {
-        // Pegando os dados da API
-        std::string weatherData = getWeatherData("21309ecc4422778de48b2f48e31143cb", "Belo%20Horizonte", "BR");
-        //std::string weatherData = getWeatherData("21309ecc4422778de48b2f48e31143cb", "Calama", "CL");
-        //std::string weatherData = getWeatherData("21309ecc4422778de48b2f48e31143cb", "Sidney", "AUS");
-        //std::string weatherData = getWeatherData("21309ecc4422778de48b2f48e31143cb", "Beijing", "CN");
-        //std::string weatherData = getWeatherData("21309ecc4422778de48b2f48e31143cb", "London", "GB");
-        
-        if (!weatherData.empty()) {
-            float temperature = 0.0f;
-            float humidity = 0.0f;
-            
-            processWeatherData(weatherData, temperature, humidity);
+    for (const WeatherSource& source : sources) {
+        publishInitialMessage(client, source.machineId, encoding);
+    }
 
-            Json::Value tempMsg;
-            tempMsg["timestamp"] = getCurrentTimestamp();
-            tempMsg["value"] = temperature;
+    std::signal(SIGINT, handleSignal);
+    std::signal(SIGTERM, handleSignal);
 
-            Json::Value humMsg;
-            humMsg["timestamp"] = getCurrentTimestamp();
-            humMsg["value"] = humidity;
+    // O anúncio acima é síncrono para chegar antes das leituras; as leituras
+    // são publicadas em pipeline
+    AsyncPublisher publisher(client);
+    std::unique_ptr<ReadingBatcher> batcher;
+    if (batch) {
+        batcher.reset(new ReadingBatcher(publisher));
+    }
 
-            Json::StreamWriterBuilder writer;
-            std::string tempMessage = Json::writeString(writer, tempMsg);
-            std::string humMessage = Json::writeString(writer, humMsg);
-            //testa publicação
-            std::cout << "temperature: " << tempMessage << std::endl << "umidity: " << humMessage << std::endl; 
-            client.publish(mqtt::make_message("/sensors/" + MACHINE_ID + "/" + SENSOR_ID_TEMPERATURE, tempMessage))->wait_for(std::chrono::seconds(10));
-            client.publish(mqtt::make_message("/sensors/" + MACHINE_ID + "/" + SENSOR_ID_HUMIDITY, humMessage))->wait_for(std::chrono::seconds(10));
-            
-            std::cout << "Published temperature and humidity. "<< std::endl;
+    // Pegando os dados da API; cada resposta é publicada (ou entra no lote)
+    // assim que chega
+    poller.run(keepRunning, [&](const WeatherSource& source, const WeatherStreamParser& reading) {
+        if (batcher) {
+            batchWeatherReading(*batcher, source.machineId, reading.temperature, reading.humidity);
+        } else {
+            publishWeatherReading(publisher, source, reading.temperature, reading.humidity, encoding);
         }
+    });
 
-        std::this_thread::sleep_for(std::chrono::seconds(DATA_INTERVAL));
+    if (batcher) {
+        batcher->stop();
     }
+    publisher.stop();
+    AsyncPublisher::Stats stats = publisher.stats();
+    std::cout << "PUBLISHER: published=" << stats.published << " retried=" << stats.retried
+              << " failed=" << stats.failed << " dropped=" << stats.dropped << std::endl;
 
     client.disconnect()->wait();
+    curl_global_cleanup();
 
     return 0;
 }
+#endif // DATA_COLLECTOR_NO_MAIN
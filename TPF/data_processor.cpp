@@ -1,265 +1,4674 @@
 #include <iostream>
 #include <string>
 #include <mqtt/async_client.h>
-#include <jsoncpp/json/json.h>
+#include "json.hpp"
 #include <chrono>
 #include <thread>
 #include <map>
 #include <mutex>
 #include <ctime>
 #include <iomanip>
+#include <vector>
+#include <atomic>
+#include <csignal>
+#include <cstdlib>
+#include <memory>
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+#include <cstdio>
+#include <cstdint>
+#include <string_view>
+#include <charconv>
+#include <cstring>
+#include <array>
+#include <deque>
+#include <unordered_map>
+#include <shared_mutex>
+#include <filesystem>
+#include <functional>
+#include <list>
+#include <random>
+#include <limits>
+#include <cmath>
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
 #include <sqlite3.h>
 
 const std::string SERVER_ADDRESS("tcp://localhost:1883");
 const std::string CLIENT_ID("DataProcessorClient");
 const std::string MACHINE_ID("machine_01");
+const std::string SENSOR_ID_TEMPERATURE("sensor_temperature");
+const std::string SENSOR_ID_HUMIDITY("sensor_humidity");
 const int DATA_INTERVAL = 10; // em segundos
+const size_t SENSOR_SHARDS = 64; // partes independentes da tabela de estado dos sensores
+const int TIMER_TICK_MS = 100; // resolução da detecção de inatividade
+const size_t BATCH_SIZE = 1000; // leituras por transação
+const int BATCH_MAX_LATENCY_MS = 1000; // tempo máximo que uma leitura espera no buffer
+const size_t STORAGE_QUEUE_CAPACITY = 65536; // linhas entre o MQTT e o SQLite
+const int WRITER_POLL_MS = 5; // intervalo de verificação da fila pela thread de escrita
+const int SPILL_RETRY_MS = 1000; // espera antes de reenviar um transbordo que falhou
+const std::string DATABASE_PATH("sensor_data.db");
+const int BUSY_TIMEOUT_MS = 5000; // espera por locks de outras conexões
+const int CHECKPOINT_INTERVAL_MS = 1000; // checkpoint passivo do WAL
+const int WAL_TRUNCATE_FRAMES = 16384; // acima disso (~64 MiB) o WAL é truncado
+const sqlite3_int64 MIGRATION_CHUNK_ROWS = 50000; // linhas por UPDATE na migração
+const std::string SENSOR_BATCH_TOPIC("/sensor_batches"); // várias leituras por mensagem
+const int SENSOR_BATCH_SCHEMA_VERSION = 1;
+const int RETENTION_INTERVAL_MS = 60000; // intervalo entre passadas do compactador
+const int RETENTION_CHUNK_ROWS = 2000; // linhas por DELETE da retenção
+const int RETENTION_CHUNK_PAUSE_MS = 20; // pausa entre DELETEs, para o BatchWriter gravar
+const size_t PARTITION_MAX_ATTACHED = 8; // partições anexadas para escrita (o SQLite aceita 10)
+const int PARTITION_CHECKPOINT_COUNT = 2; // partições mais novas checkpointadas em segundo plano
+const std::string COLUMN_STORE_DIR("sensor_columns"); // um arquivo por sensor
+const uint16_t COLUMN_BLOCK_READINGS = 1024; // leituras por bloco comprimido
+const size_t COLUMN_MAX_OPEN_SERIES = 256; // arquivos de série abertos ao mesmo tempo (LRU)
+const int COLUMN_RETRY_MS = 1000; // espera antes de regravar leituras que o armazenamento colunar recusou
+const int COLUMN_REFUSED = 1; // append: timestamp repetido ou fora de ordem na série
+
+using json = nlohmann::json;
+
+// Sinaliza o encerramento do processo (SIGINT/SIGTERM)
+std::atomic<bool> keepRunning(true);
 
 // Conexão com banco de dados SQLite
 sqlite3* db;
 
-int createTables() {
-    const char* createSensorsTableSQL = R"(
-        CREATE TABLE IF NOT EXISTS sensor_data (
-            id INTEGER PRIMARY KEY AUTOINCREMENT,
-            machine_id TEXT,
-            sensor_id TEXT,
-            value REAL,
-            timestamp TEXT
-        );
-    )";
-    
-    const char* createAlarmsTableSQL = R"(
-        CREATE TABLE IF NOT EXISTS alarms (
-            id INTEGER PRIMARY KEY AUTOINCREMENT,
-            machine_id TEXT,
-            alarm_type TEXT,
-            timestamp TEXT
-        );
-    )";
-    char* errorMessage;
+// Timestamps circulam internamente como nanossegundos desde a época (UTC).
+// O texto ISO-8601 só existe nas bordas: payload MQTT, coluna TEXT e logs.
+using Timestamp = int64_t;
+
+const Timestamp NANOS_PER_SECOND = 1000000000;
+
+Timestamp currentTimestamp() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+// Dias desde 1970-01-01 para uma data do calendário gregoriano
+int64_t daysFromCivil(int64_t year, unsigned month, unsigned day) {
+    year -= month <= 2;
+    int64_t era = (year >= 0 ? year : year - 399) / 400;
+    unsigned yearOfEra = (unsigned)(year - era * 400);
+    unsigned dayOfYear = (153 * (month + (month > 2 ? -3 : 9)) + 2) / 5 + day - 1;
+    unsigned dayOfEra = yearOfEra * 365 + yearOfEra / 4 - yearOfEra / 100 + dayOfYear;
+    return era * 146097 + (int64_t)dayOfEra - 719468;
+}
+
+// Lê "YYYY-MM-DDTHH:MM:SS[.fração]Z" sem alocar
+bool parseTimestamp(std::string_view text, Timestamp& out) {
+    auto digits = [&](size_t pos, size_t count, int& value) {
+        if (pos + count > text.size()) {
+            return false;
+        }
+        value = 0;
+        for (size_t i = pos; i < pos + count; i++) {
+            if (text[i] < '0' || text[i] > '9') {
+                return false;
+            }
+            value = value * 10 + (text[i] - '0');
+        }
+        return true;
+    };
+    int year, month, day, hour, minute, second;
+    if (!digits(0, 4, year) || !digits(5, 2, month) || !digits(8, 2, day) ||
+        !digits(11, 2, hour) || !digits(14, 2, minute) || !digits(17, 2, second) ||
+        text[4] != '-' || text[7] != '-' || (text[10] != 'T' && text[10] != ' ') ||
+        text[13] != ':' || text[16] != ':' || month < 1 || month > 12 || day < 1 || day > 31) {
+        return false;
+    }
+
+    size_t pos = 19;
+    Timestamp fraction = 0;
+    if (pos < text.size() && text[pos] == '.') {
+        Timestamp scale = NANOS_PER_SECOND;
+        for (pos++; pos < text.size() && text[pos] >= '0' && text[pos] <= '9'; pos++) {
+            if (scale > 1) {
+                scale /= 10;
+                fraction += (text[pos] - '0') * scale;
+            }
+        }
+    }
+    if (pos + 1 != text.size() || text[pos] != 'Z') {
+        return false;
+    }
+
+    int64_t seconds = daysFromCivil(year, month, day) * 86400 + hour * 3600 + minute * 60 + second;
+    out = seconds * NANOS_PER_SECOND + fraction;
+    return true;
+}
+
+// Escreve "YYYY-MM-DDTHH:MM:SSZ" em out (mínimo de 21 bytes) e devolve o tamanho
+size_t formatTimestamp(Timestamp ts, char* out) {
+    time_t seconds = (time_t)(ts / NANOS_PER_SECOND - (ts % NANOS_PER_SECOND < 0 ? 1 : 0));
+    std::tm utc;
+    gmtime_r(&seconds, &utc);
+    return std::strftime(out, 21, "%Y-%m-%dT%H:%M:%SZ", &utc);
+}
+
+std::string formatTimestamp(Timestamp ts) {
+    char buffer[32];
+    return std::string(buffer, formatTimestamp(ts, buffer));
+}
+
+// "30s", "15m", "1h", "7d", "2w" em nanossegundos
+bool parseDuration(std::string_view text, int64_t& out) {
+    int64_t amount = 0;
+    auto result = std::from_chars(text.data(), text.data() + text.size(), amount);
+    if (result.ec != std::errc() || amount <= 0 || result.ptr + 1 != text.data() + text.size()) {
+        return false;
+    }
+    switch (*result.ptr) {
+    case 's': out = amount * NANOS_PER_SECOND; return true;
+    case 'm': out = amount * 60 * NANOS_PER_SECOND; return true;
+    case 'h': out = amount * 3600 * NANOS_PER_SECOND; return true;
+    case 'd': out = amount * 86400 * NANOS_PER_SECOND; return true;
+    case 'w': out = amount * 7 * 86400 * NANOS_PER_SECOND; return true;
+    default: return false;
+    }
+}
+
+int execSQL(const char* sql) {
+    char* errorMessage;
+    if (sqlite3_exec(db, sql, 0, 0, &errorMessage) != SQLITE_OK) {
+        std::cerr << "Error executing " << sql << ": " << errorMessage << std::endl;
+        sqlite3_free(errorMessage);
+        return -1;
+    }
+    return 0;
+}
+
+// timestamp_to_ns(texto) no SQL: parseTimestamp, ou NULL se o texto não
+// estiver em "YYYY-MM-DDTHH:MM:SS[.fração]Z"
+void timestampToNsSQL(sqlite3_context* context, int, sqlite3_value** args) {
+    const unsigned char* text = sqlite3_value_text(args[0]);
+    Timestamp timestamp;
+    if (text && parseTimestamp(std::string_view((const char*)text, sqlite3_value_bytes(args[0])), timestamp)) {
+        sqlite3_result_int64(context, timestamp);
+    } else {
+        sqlite3_result_null(context);
+    }
+}
+
+bool columnExists(const std::string& table, const char* column) {
+    bool exists = false;
+    sqlite3_stmt* stmt;
+    std::string sql = "PRAGMA table_info(" + table + ");";
+    if (sqlite3_prepare_v2(db, sql.c_str(), -1, &stmt, 0) != SQLITE_OK) {
+        std::cerr << "Error preparing statement: " << sqlite3_errmsg(db) << std::endl;
+        return false;
+    }
+    while (sqlite3_step(stmt) == SQLITE_ROW) {
+        if (std::string((const char*)sqlite3_column_text(stmt, 1)) == column) {
+            exists = true;
+        }
+    }
+    sqlite3_finalize(stmt);
+    return exists;
+}
+
+// Bancos criados antes da coluna timestamp_ns: adiciona a coluna e preenche
+// a partir do texto ISO-8601, em blocos de rowid para não segurar o lock de
+// escrita por muito tempo. Se a coluna já existe, uma migração interrompida
+// continua das linhas ainda em NULL. O texto é lido por parseTimestamp
+// (com a fração de segundo); outros formatos aceitos pelo strftime do SQLite
+// entram com segundos inteiros, e linhas com texto inválido ficam com NULL.
+int migrateTimestampColumn(const std::string& table) {
+    sqlite3_stmt* stmt;
+    std::string sql;
+    if (columnExists(table, "timestamp_ns")) {
+        std::cout << "Resuming migration of " << table << " to integer timestamps..." << std::endl;
+    } else {
+        std::cout << "Migrating " << table << " to integer timestamps..." << std::endl;
+        sql = "ALTER TABLE " + table + " ADD COLUMN timestamp_ns INTEGER;";
+        if (execSQL(sql.c_str()) != 0) {
+            return -1;
+        }
+    }
+    if (sqlite3_create_function(db, "timestamp_to_ns", 1, SQLITE_UTF8 | SQLITE_DETERMINISTIC, nullptr,
+                                timestampToNsSQL, nullptr, nullptr) != SQLITE_OK) {
+        std::cerr << "Error registering timestamp_to_ns: " << sqlite3_errmsg(db) << std::endl;
+        return -1;
+    }
+
+    sql = "SELECT COALESCE(MAX(rowid), 0) FROM " + table + ";";
+    sqlite3_int64 maxRowid = 0;
+    if (sqlite3_prepare_v2(db, sql.c_str(), -1, &stmt, 0) != SQLITE_OK) {
+        std::cerr << "Error preparing statement: " << sqlite3_errmsg(db) << std::endl;
+        return -1;
+    }
+    if (sqlite3_step(stmt) == SQLITE_ROW) {
+        maxRowid = sqlite3_column_int64(stmt, 0);
+    }
+    sqlite3_finalize(stmt);
+
+    sql = "UPDATE " + table + " SET timestamp_ns = COALESCE(timestamp_to_ns(timestamp),"
+          " CAST(strftime('%s', timestamp) AS INTEGER) * 1000000000)"
+          " WHERE rowid > ? AND rowid <= ? AND timestamp_ns IS NULL AND timestamp IS NOT NULL;";
+    if (sqlite3_prepare_v2(db, sql.c_str(), -1, &stmt, 0) != SQLITE_OK) {
+        std::cerr << "Error preparing statement: " << sqlite3_errmsg(db) << std::endl;
+        return -1;
+    }
+    for (sqlite3_int64 first = 0; first < maxRowid; first += MIGRATION_CHUNK_ROWS) {
+        sqlite3_bind_int64(stmt, 1, first);
+        sqlite3_bind_int64(stmt, 2, first + MIGRATION_CHUNK_ROWS);
+        if (sqlite3_step(stmt) != SQLITE_DONE) {
+            std::cerr << "Error migrating " << table << ": " << sqlite3_errmsg(db) << std::endl;
+            sqlite3_finalize(stmt);
+            return -1;
+        }
+        sqlite3_reset(stmt);
+    }
+    sqlite3_finalize(stmt);
+    return 0;
+}
+
+bool tableExists(const char* name) {
+    sqlite3_stmt* stmt;
+    if (sqlite3_prepare_v2(db, "SELECT 1 FROM sqlite_master WHERE type = 'table' AND name = ?;", -1, &stmt, 0) != SQLITE_OK) {
+        return false;
+    }
+    sqlite3_bind_text(stmt, 1, name, -1, SQLITE_STATIC);
+    bool exists = sqlite3_step(stmt) == SQLITE_ROW;
+    sqlite3_finalize(stmt);
+    return exists;
+}
+
+sqlite3_int64 countRows(const char* table) {
+    sqlite3_stmt* stmt;
+    std::string sql = std::string("SELECT COUNT(*) FROM ") + table + ";";
+    sqlite3_int64 count = 0;
+    if (sqlite3_prepare_v2(db, sql.c_str(), -1, &stmt, 0) == SQLITE_OK && sqlite3_step(stmt) == SQLITE_ROW) {
+        count = sqlite3_column_int64(stmt, 0);
+    }
+    sqlite3_finalize(stmt);
+    return count;
+}
+
+// Bancos do esquema antigo guardam machine_id/sensor_id/alarm_type em texto
+// em cada linha de sensor_data e alarms. A migração preenche as dimensões,
+// copia as linhas para readings/alarm_events e renomeia as tabelas antigas
+// para sensor_data_legacy e alarms_legacy em uma única transação: ou o banco
+// migra inteiro ou continua como estava. Linhas sem timestamp válido não têm
+// como entrar na chave e ficam de fora; leituras repetidas do mesmo sensor no
+// mesmo instante viram uma só (a última gravada). Essas linhas continuam nas
+// tabelas *_legacy, que só saem com um DROP TABLE manual.
+int migrateLegacySchema() {
+    bool legacyReadings = tableExists("sensor_data");
+    bool legacyAlarms = tableExists("alarms");
+    if (!legacyReadings && !legacyAlarms) {
+        return 0;
+    }
+    if ((legacyReadings && migrateTimestampColumn("sensor_data") != 0) ||
+        (legacyAlarms && migrateTimestampColumn("alarms") != 0)) {
+        return -1;
+    }
+
+    sqlite3_int64 legacyReadingRows = legacyReadings ? countRows("sensor_data") : 0;
+    sqlite3_int64 legacyAlarmRows = legacyAlarms ? countRows("alarms") : 0;
+    std::cout << "Migrating " << legacyReadingRows << " readings and " << legacyAlarmRows
+              << " alarms to the normalized schema..." << std::endl;
+
+    std::vector<const char*> steps;
+    if (legacyReadings) {
+        steps.push_back("INSERT OR IGNORE INTO machines (name)"
+                        " SELECT DISTINCT machine_id FROM sensor_data WHERE machine_id IS NOT NULL;");
+        steps.push_back("INSERT OR IGNORE INTO sensors (machine, name)"
+                        " SELECT DISTINCT m.id, d.sensor_id FROM sensor_data d JOIN machines m ON m.name = d.machine_id"
+                        " WHERE d.sensor_id IS NOT NULL;");
+        // Na ordem da chave as páginas de readings são preenchidas em sequência
+        steps.push_back("INSERT OR REPLACE INTO readings (sensor, timestamp_ns, value)"
+                        " SELECT s.id, d.timestamp_ns, d.value FROM sensor_data d"
+                        " JOIN machines m ON m.name = d.machine_id"
+                        " JOIN sensors s ON s.machine = m.id AND s.name = d.sensor_id"
+                        " WHERE d.timestamp_ns IS NOT NULL ORDER BY s.id, d.timestamp_ns, d.id;");
+        steps.push_back("ALTER TABLE sensor_data RENAME TO sensor_data_legacy;");
+    }
+    if (legacyAlarms) {
+        steps.push_back("INSERT OR IGNORE INTO machines (name)"
+                        " SELECT DISTINCT machine_id FROM alarms WHERE machine_id IS NOT NULL;");
+        steps.push_back("INSERT OR IGNORE INTO alarm_types (name)"
+                        " SELECT DISTINCT alarm_type FROM alarms WHERE alarm_type IS NOT NULL;");
+        steps.push_back("INSERT INTO alarm_events (machine, alarm_type, timestamp_ns)"
+                        " SELECT m.id, t.id, a.timestamp_ns FROM alarms a"
+                        " JOIN machines m ON m.name = a.machine_id"
+                        " JOIN alarm_types t ON t.name = a.alarm_type"
+                        " WHERE a.timestamp_ns IS NOT NULL ORDER BY a.timestamp_ns, a.id;");
+        steps.push_back("ALTER TABLE alarms RENAME TO alarms_legacy;");
+    }
+
+    sqlite3_int64 readingRows = countRows("readings");
+    sqlite3_int64 alarmRows = countRows("alarm_events");
+    if (execSQL("BEGIN;") != 0) {
+        return -1;
+    }
+    for (const char* step : steps) {
+        if (execSQL(step) != 0) {
+            execSQL("ROLLBACK;");
+            return -1;
+        }
+    }
+    if (execSQL("COMMIT;") != 0) {
+        execSQL("ROLLBACK;");
+        return -1;
+    }
+    sqlite3_int64 skippedReadings = legacyReadingRows - (countRows("readings") - readingRows);
+    sqlite3_int64 skippedAlarms = legacyAlarmRows - (countRows("alarm_events") - alarmRows);
+    std::cout << "Migrated " << legacyReadingRows - skippedReadings << " readings and "
+              << legacyAlarmRows - skippedAlarms << " alarms" << std::endl;
+    if (skippedReadings > 0 || skippedAlarms > 0) {
+        std::cerr << "Migration skipped " << skippedReadings << " readings and " << skippedAlarms
+                  << " alarms (duplicate or invalid timestamp); they remain in sensor_data_legacy"
+                  << " and alarms_legacy" << std::endl;
+    }
+    return 0;
+}
+
+// Versões anteriores usavam (machine, timestamp_ns, alarm_type) como chave
+// de alarm_events, o que descartava alarmes repetidos no mesmo instante.
+// Recria a tabela com chave rowid mantendo as linhas; a view alarms é
+// recriada por createTables.
+int upgradeAlarmEvents() {
+    if (!tableExists("alarm_events") || columnExists("alarm_events", "id")) {
+        return 0;
+    }
+    std::cout << "Upgrading alarm_events to one row per alarm..." << std::endl;
+    const char* steps[] = {
+        "DROP VIEW IF EXISTS alarms;",
+        "DROP INDEX IF EXISTS alarm_events_by_time;",
+        "ALTER TABLE alarm_events RENAME TO alarm_events_keyed;",
+        "CREATE TABLE alarm_events ("
+        " id INTEGER PRIMARY KEY,"
+        " machine INTEGER NOT NULL REFERENCES machines (id),"
+        " alarm_type INTEGER NOT NULL REFERENCES alarm_types (id),"
+        " timestamp_ns INTEGER NOT NULL);",
+        "INSERT INTO alarm_events (machine, alarm_type, timestamp_ns)"
+        " SELECT machine, alarm_type, timestamp_ns FROM alarm_events_keyed ORDER BY timestamp_ns;",
+        "DROP TABLE alarm_events_keyed;",
+    };
+    if (execSQL("BEGIN;") != 0) {
+        return -1;
+    }
+    for (const char* step : steps) {
+        if (execSQL(step) != 0) {
+            execSQL("ROLLBACK;");
+            return -1;
+        }
+    }
+    if (execSQL("COMMIT;") != 0) {
+        execSQL("ROLLBACK;");
+        return -1;
+    }
+    return 0;
+}
+
+// Início do intervalo de bucketNs (alinhado à época) que contém timestamp.
+// A divisão inteira trunca em direção a zero, o que antes da época daria o
+// intervalo seguinte.
+Timestamp bucketStartOf(Timestamp timestamp, int64_t bucketNs) {
+    Timestamp start = timestamp / bucketNs * bucketNs;
+    return start > timestamp ? start - bucketNs : start;
+}
+
+// Níveis de rollup, do mais fino para o mais grosso. Cada tabela guarda, por
+// sensor e intervalo alinhado à época, min/max/soma/contagem e a última
+// leitura junto com o timestamp dela, para que uma leitura atrasada não
+// tome o lugar da última. A média é soma/contagem, o que deixa juntar
+// intervalos sem perder exatidão.
+struct RollupLevel {
+    const char* table;
+    int64_t bucketNs;
+    std::string upsertSQL;
+    std::string selectSQL;
+};
+
+// Junta o agregado novo ao já gravado no mesmo (sensor, intervalo)
+const std::string ROLLUP_MERGE_SQL =
+    " ON CONFLICT (sensor, bucket_ns) DO UPDATE SET"
+    " min = MIN(min, excluded.min), max = MAX(max, excluded.max),"
+    " sum = sum + excluded.sum, count = count + excluded.count,"
+    " last = CASE WHEN excluded.last_ns >= last_ns THEN excluded.last ELSE last END,"
+    " last_ns = MAX(last_ns, excluded.last_ns);";
+
+RollupLevel makeRollupLevel(const char* table, int64_t bucketNs) {
+    std::string name(table);
+    return {table, bucketNs,
+            "INSERT INTO " + name + " (sensor, bucket_ns, min, max, sum, count, last_ns, last)"
+            " VALUES (?, ?, ?, ?, ?, ?, ?, ?)" + ROLLUP_MERGE_SQL,
+            "SELECT bucket_ns, min, max, sum, count, last_ns, last FROM " + name +
+            " WHERE sensor = ? AND bucket_ns BETWEEN ? AND ? ORDER BY bucket_ns;"};
+}
+
+const RollupLevel ROLLUP_LEVELS[] = {
+    makeRollupLevel("rollups_1m", 60 * NANOS_PER_SECOND),
+    makeRollupLevel("rollups_1h", 3600 * NANOS_PER_SECOND),
+    makeRollupLevel("rollups_1d", 86400 * NANOS_PER_SECOND),
+};
+const int ROLLUP_LEVEL_COUNT = 3;
+
+// Relógio monotônico em nanossegundos, para medir inatividade sem depender
+// do relógio de quem publicou a leitura
+int64_t steadyNanos() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Estrutura para armazenar dados dos sensores
+struct SensorData {
+    float value;
+    Timestamp timestamp;
+    int missed_periods = 0;
+    int64_t lastArrival = 0; // steadyNanos() da última leitura (ou do anúncio)
+    int64_t intervalNs = DATA_INTERVAL * NANOS_PER_SECOND; // período anunciado
+    bool hasReading = true; // false para sensor anunciado que ainda não publicou
+    int64_t armedDeadline = 0; // prazo do timer válido na TimerWheel
+};
+
+// Statement preparado reutilizável. Ao sair de escopo volta ao estado
+// inicial (sqlite3_reset + sqlite3_clear_bindings) para a próxima chamada.
+class CachedStatement {
+private:
+    sqlite3_stmt* stmt;
+
+public:
+    explicit CachedStatement(sqlite3_stmt* statement) : stmt(statement) {}
+    CachedStatement(const CachedStatement&) = delete;
+    CachedStatement& operator=(const CachedStatement&) = delete;
+
+    ~CachedStatement() {
+        if (stmt) {
+            sqlite3_reset(stmt);
+            sqlite3_clear_bindings(stmt);
+        }
+    }
+
+    bool valid() const { return stmt != nullptr; }
+    sqlite3_stmt* get() const { return stmt; }
+
+    // O texto precisa continuar vivo até o step()
+    void bind(int index, std::string_view text) {
+        sqlite3_bind_text(stmt, index, text.data(), (int)text.size(), SQLITE_STATIC);
+    }
+    void bind(int index, double value) {
+        sqlite3_bind_double(stmt, index, value);
+    }
+    void bind(int index, int value) {
+        sqlite3_bind_int(stmt, index, value);
+    }
+    void bind(int index, sqlite3_int64 value) {
+        sqlite3_bind_int64(stmt, index, value);
+    }
+
+    int step() {
+        return sqlite3_step(stmt);
+    }
+};
+
+// Cache de statements: cada SQL é preparado uma única vez sobre a conexão
+// global db e reutilizado. Cada statement deve ser usado por uma thread
+// de cada vez (aqui, a thread do BatchWriter).
+class StatementCache {
+private:
+    std::map<std::string, sqlite3_stmt*> statements;
+    std::mutex cacheMutex;
+
+public:
+    CachedStatement get(const std::string& sql) {
+        std::lock_guard<std::mutex> lock(cacheMutex);
+        auto it = statements.find(sql);
+        if (it != statements.end()) {
+            return CachedStatement(it->second);
+        }
+
+        sqlite3_stmt* stmt;
+        if (sqlite3_prepare_v2(db, sql.c_str(), -1, &stmt, 0) != SQLITE_OK) {
+            std::cerr << "Error preparing statement: " << sqlite3_errmsg(db) << std::endl;
+            return CachedStatement(nullptr);
+        }
+        statements[sql] = stmt;
+        return CachedStatement(stmt);
+    }
+
+    // Finaliza os statements cujo SQL contém text (p.ex. um schema anexado
+    // que vai ser desanexado)
+    void erase(const std::string& text) {
+        std::lock_guard<std::mutex> lock(cacheMutex);
+        for (auto it = statements.begin(); it != statements.end();) {
+            if (it->first.find(text) != std::string::npos) {
+                sqlite3_finalize(it->second);
+                it = statements.erase(it);
+            } else {
+                ++it;
+            }
+        }
+    }
+
+    // Precisa ser chamado antes de sqlite3_close
+    void clear() {
+        std::lock_guard<std::mutex> lock(cacheMutex);
+        for (auto& entry : statements) {
+            sqlite3_finalize(entry.second);
+        }
+        statements.clear();
+    }
+};
+
+StatementCache statementCache;
+
+// Ids inteiros das tabelas de dimensão, carregados do banco no primeiro uso
+// (o main carrega na abertura). Um nome novo é inserido na primeira vez que
+// aparece, dentro da transação do lote em andamento; se o lote for desfeito,
+// clear() descarta o cache, que volta a ser lido do banco. Também precisa
+// ser chamado antes de sqlite3_close, como o StatementCache.
+class DimensionIds {
+private:
+    std::unordered_map<std::string, sqlite3_int64> machines;
+    std::unordered_map<std::string, sqlite3_int64> sensors; // "<machine_id>/<sensor_id>"
+    std::unordered_map<std::string, sqlite3_int64> alarmTypes;
+    bool loaded = false;
+    std::string key; // reaproveitada para não alocar a cada busca
+    std::mutex idsMutex;
+
+    static int loadTable(const char* sql, std::unordered_map<std::string, sqlite3_int64>& ids) {
+        sqlite3_stmt* stmt;
+        if (sqlite3_prepare_v2(db, sql, -1, &stmt, 0) != SQLITE_OK) {
+            std::cerr << "Error preparing statement: " << sqlite3_errmsg(db) << std::endl;
+            return -1;
+        }
+        while (sqlite3_step(stmt) == SQLITE_ROW) {
+            ids[(const char*)sqlite3_column_text(stmt, 1)] = sqlite3_column_int64(stmt, 0);
+        }
+        sqlite3_finalize(stmt);
+        return 0;
+    }
+
+    int ensureLoaded() {
+        if (loaded) {
+            return 0;
+        }
+        if (loadTable("SELECT id, name FROM machines;", machines) != 0 ||
+            loadTable("SELECT s.id, m.name || '/' || s.name FROM sensors s JOIN machines m ON m.id = s.machine;", sensors) != 0 ||
+            loadTable("SELECT id, name FROM alarm_types;", alarmTypes) != 0) {
+            return -1;
+        }
+        loaded = true;
+        return 0;
+    }
+
+    // INSERT OR IGNORE seguido do SELECT do id; só roda para nomes novos.
+    // parent é o id da máquina para sensores, -1 para as outras dimensões.
+    static sqlite3_int64 insert(const std::string& insertSQL, const std::string& selectSQL,
+                                std::string_view name, sqlite3_int64 parent) {
+        {
+            CachedStatement stmt = statementCache.get(insertSQL);
+            if (!stmt.valid()) {
+                return -1;
+            }
+            stmt.bind(1, name);
+            if (parent >= 0) {
+                stmt.bind(2, parent);
+            }
+            if (stmt.step() != SQLITE_DONE) {
+                std::cerr << "Error executing statement: " << sqlite3_errmsg(db) << std::endl;
+                return -1;
+            }
+        }
+        CachedStatement stmt = statementCache.get(selectSQL);
+        if (!stmt.valid()) {
+            return -1;
+        }
+        stmt.bind(1, name);
+        if (parent >= 0) {
+            stmt.bind(2, parent);
+        }
+        if (stmt.step() != SQLITE_ROW) {
+            std::cerr << "Error resolving id of " << name << ": " << sqlite3_errmsg(db) << std::endl;
+            return -1;
+        }
+        return sqlite3_column_int64(stmt.get(), 0);
+    }
+
+    sqlite3_int64 machineLocked(std::string_view name) {
+        key.assign(name);
+        auto it = machines.find(key);
+        if (it != machines.end()) {
+            return it->second;
+        }
+        sqlite3_int64 id = insert("INSERT OR IGNORE INTO machines (name) VALUES (?);",
+                                  "SELECT id FROM machines WHERE name = ?;", name, -1);
+        if (id >= 0) {
+            machines.emplace(name, id);
+        }
+        return id;
+    }
+
+public:
+    int load() {
+        std::lock_guard<std::mutex> lock(idsMutex);
+        return ensureLoaded();
+    }
+
+    sqlite3_int64 machine(std::string_view name) {
+        std::lock_guard<std::mutex> lock(idsMutex);
+        return ensureLoaded() == 0 ? machineLocked(name) : -1;
+    }
+
+    sqlite3_int64 sensor(std::string_view machineId, std::string_view sensorId) {
+        std::lock_guard<std::mutex> lock(idsMutex);
+        if (ensureLoaded() != 0) {
+            return -1;
+        }
+        key.assign(machineId);
+        key += '/';
+        key += sensorId;
+        auto it = sensors.find(key);
+        if (it != sensors.end()) {
+            return it->second;
+        }
+        sqlite3_int64 machineRow = machineLocked(machineId);
+        if (machineRow < 0) {
+            return -1;
+        }
+        sqlite3_int64 id = insert("INSERT OR IGNORE INTO sensors (name, machine) VALUES (?, ?);",
+                                  "SELECT id FROM sensors WHERE name = ? AND machine = ?;", sensorId, machineRow);
+        if (id >= 0) {
+            std::string sensorKey(machineId);
+            sensorKey += '/';
+            sensorKey += sensorId;
+            sensors.emplace(std::move(sensorKey), id);
+        }
+        return id;
+    }
+
+    sqlite3_int64 alarmType(std::string_view name) {
+        std::lock_guard<std::mutex> lock(idsMutex);
+        if (ensureLoaded() != 0) {
+            return -1;
+        }
+        key.assign(name);
+        auto it = alarmTypes.find(key);
+        if (it != alarmTypes.end()) {
+            return it->second;
+        }
+        sqlite3_int64 id = insert("INSERT OR IGNORE INTO alarm_types (name) VALUES (?);",
+                                  "SELECT id FROM alarm_types WHERE name = ?;", name, -1);
+        if (id >= 0) {
+            alarmTypes.emplace(name, id);
+        }
+        return id;
+    }
+
+    void clear() {
+        std::lock_guard<std::mutex> lock(idsMutex);
+        machines.clear();
+        sensors.clear();
+        alarmTypes.clear();
+        loaded = false;
+    }
+};
+
+DimensionIds dimensionIds;
+
+// Uma leitura repetida (mesmo sensor e instante, p.ex. reentrega QoS 1 ou
+// transbordo reenviado) é ignorada em vez de derrubar o lote; quem grava
+// confere sqlite3_changes() para não somá-la de novo nos rollups. schema é
+// "main" ou uma partição anexada.
+std::string insertReadingSQL(const std::string& schema) {
+    return "INSERT INTO " + schema + ".readings (sensor, timestamp_ns, value) VALUES (?, ?, ?)"
+           " ON CONFLICT DO NOTHING;";
+}
+
+const std::string INSERT_READING_SQL = insertReadingSQL("main");
+
+// Caminho de um arquivo de partição: no mesmo diretório do banco principal
+std::string partitionPath(const std::string& databasePath, const std::string& file) {
+    return (std::filesystem::path(databasePath).parent_path() / file).string();
+}
+
+// Leituras por janela de tempo (--partition=<duração>). Cada janela
+// [início, início + duração) vai para um arquivo próprio ao lado do banco
+// principal ("sensor_data-20250101T000000Z.db"), com a mesma tabela
+// readings. O banco principal guarda as dimensões, os alarmes, os rollups,
+// as leituras gravadas antes de particionar e o catálogo das partições
+// (tabela partitions). Uma partição só fica anexada (ATTACH) à conexão
+// global enquanto é usada: o BatchWriter mantém as do lote em andamento
+// (até PARTITION_MAX_ATTACHED) e as consultas anexam só as partições que
+// cruzam o período pedido. Assim a partição quente continua pequena e no
+// cache, e expirar uma janela inteira é apagar um arquivo. O catálogo em
+// memória é da thread do BatchWriter: o RetentionCompactor só pede, por
+// retire(), que uma janela expirada saia, e quem desanexa, tira do catálogo
+// e apaga o arquivo é dropRetired(), na thread de escrita e fora de transação.
+// Em WAL, um COMMIT que toca mais de um arquivo é atômico em cada arquivo,
+// mas não no conjunto: uma queda no meio pode gravar as leituras de um lote
+// sem os rollups dele (ou o contrário).
+class PartitionSet {
+private:
+    struct Partition {
+        Timestamp start;
+        Timestamp end;
+        std::string file;
+        std::string schema;
+        std::string insertSQL;
+        bool attached = false;
+        uint64_t lastUse = 0;
+    };
+
+    std::string databasePath;
+    int64_t windowNs = 0;
+    std::map<Timestamp, Partition> catalog; // pelo início da janela
+    Partition* hot = nullptr; // última partição usada por um insert
+    size_t attachedCount = 0;
+    uint64_t useClock = 0;
+    uint64_t attaches = 0;
+    Timestamp expiredBefore = std::numeric_limits<Timestamp>::min(); // fim da última janela apagada
+    std::mutex retiringMutex;
+    std::vector<Timestamp> retiring; // janelas pedidas por retire(), ainda não apagadas
+
+    Partition* find(Timestamp timestamp) {
+        auto it = catalog.upper_bound(timestamp);
+        if (it == catalog.begin()) {
+            return nullptr;
+        }
+        --it;
+        return timestamp < it->second.end ? &it->second : nullptr;
+    }
+
+    // Copia journal_mode, synchronous e cache_size do banco principal
+    int configure(const std::string& schema) {
+        const char* pragmas[] = {"journal_mode", "synchronous", "cache_size"};
+        for (const char* pragma : pragmas) {
+            sqlite3_stmt* stmt;
+            std::string value;
+            std::string sql = std::string("PRAGMA main.") + pragma + ";";
+            if (sqlite3_prepare_v2(db, sql.c_str(), -1, &stmt, 0) == SQLITE_OK && sqlite3_step(stmt) == SQLITE_ROW) {
+                value = (const char*)sqlite3_column_text(stmt, 0);
+            }
+            sqlite3_finalize(stmt);
+            sql = "PRAGMA " + schema + "." + pragma + "=" + value + ";";
+            if (value.empty() || execSQL(sql.c_str()) != 0) {
+                return -1;
+            }
+        }
+        return 0;
+    }
+
+    int attach(Partition& partition) {
+        sqlite3_stmt* stmt;
+        std::string sql = "ATTACH DATABASE ? AS " + partition.schema + ";";
+        if (sqlite3_prepare_v2(db, sql.c_str(), -1, &stmt, 0) != SQLITE_OK) {
+            std::cerr << "Error preparing statement: " << sqlite3_errmsg(db) << std::endl;
+            return -1;
+        }
+        std::string path = partitionPath(databasePath, partition.file);
+        sqlite3_bind_text(stmt, 1, path.c_str(), -1, SQLITE_TRANSIENT);
+        int rc = sqlite3_step(stmt);
+        sqlite3_finalize(stmt);
+        if (rc != SQLITE_DONE) {
+            std::cerr << "Error attaching partition " << path << ": " << sqlite3_errmsg(db) << std::endl;
+            return -1;
+        }
+        partition.attached = true;
+        attachedCount++;
+        attaches++;
+        return 0;
+    }
+
+    // Os statements em cache que usam a partição são finalizados antes
+    int detach(Partition& partition) {
+        statementCache.erase(partition.schema + ".");
+        if (hot == &partition) {
+            hot = nullptr;
+        }
+        partition.attached = false;
+        attachedCount--;
+        return execSQL(("DETACH DATABASE " + partition.schema + ";").c_str());
+    }
+
+    // Anexa com as configurações do banco principal e garante a tabela
+    // readings, mesmo que o arquivo tenha sumido desde o catálogo
+    int attachForWriting(Partition& partition) {
+        // Sem REFERENCES: a chave estrangeira não atravessa arquivos
+        std::string createSQL = "CREATE TABLE IF NOT EXISTS " + partition.schema + ".readings ("
+                                " sensor INTEGER NOT NULL, timestamp_ns INTEGER NOT NULL, value REAL,"
+                                " PRIMARY KEY (sensor, timestamp_ns)) WITHOUT ROWID;";
+        if (attach(partition) != 0 || configure(partition.schema) != 0 || execSQL(createSQL.c_str()) != 0) {
+            return -1;
+        }
+        return 0;
+    }
+
+    int detachLeastRecent() {
+        Partition* oldest = nullptr;
+        for (auto& entry : catalog) {
+            Partition& partition = entry.second;
+            if (partition.attached && partition.lastUse < useClock && (!oldest || partition.lastUse < oldest->lastUse)) {
+                oldest = &partition;
+            }
+        }
+        if (!oldest) {
+            std::cerr << "Too many partitions attached" << std::endl;
+            return -1;
+        }
+        return detach(*oldest);
+    }
+
+    // Cria (ou reabre) a partição que começa em start e vai até o fim da
+    // janela alinhada ou até a partição seguinte
+    int create(Timestamp start) {
+        char name[32];
+        time_t seconds = (time_t)(start / NANOS_PER_SECOND);
+        std::tm utc;
+        gmtime_r(&seconds, &utc);
+        std::strftime(name, sizeof(name), "%Y%m%dT%H%M%SZ", &utc);
+
+        Timestamp end = start - ((start % windowNs) + windowNs) % windowNs + windowNs;
+        auto next = catalog.upper_bound(start);
+        if (next != catalog.end()) {
+            end = std::min(end, next->first);
+        }
+        Partition& partition = catalog[start];
+        partition.start = start;
+        partition.end = end;
+        partition.file = std::filesystem::path(databasePath).stem().string() + "-" + name + ".db";
+        partition.schema = std::string("p") + name;
+        partition.insertSQL = insertReadingSQL(partition.schema);
+        if (attachForWriting(partition) != 0) {
+            return -1;
+        }
+
+        sqlite3_stmt* stmt;
+        if (sqlite3_prepare_v2(db, "INSERT OR IGNORE INTO partitions (start_ns, end_ns, file) VALUES (?, ?, ?);",
+                               -1, &stmt, 0) != SQLITE_OK) {
+            std::cerr << "Error preparing statement: " << sqlite3_errmsg(db) << std::endl;
+            return -1;
+        }
+        sqlite3_bind_int64(stmt, 1, start);
+        sqlite3_bind_int64(stmt, 2, partition.end);
+        sqlite3_bind_text(stmt, 3, partition.file.c_str(), -1, SQLITE_TRANSIENT);
+        int rc = sqlite3_step(stmt);
+        sqlite3_finalize(stmt);
+        if (rc != SQLITE_DONE) {
+            std::cerr << "Error registering partition " << partition.file << ": " << sqlite3_errmsg(db) << std::endl;
+            return -1;
+        }
+        // A view sensor_data só lê main.readings; ver createTables
+        return execSQL("DROP VIEW IF EXISTS main.sensor_data;");
+    }
+
+public:
+    // Carrega o catálogo; window = 0 só lê as partições existentes (consultas)
+    int open(const std::string& path, int64_t window) {
+        for (auto& entry : catalog) {
+            if (entry.second.attached) {
+                detach(entry.second);
+            }
+        }
+        clear();
+        databasePath = path;
+        windowNs = window;
+        if (!tableExists("partitions")) {
+            return 0;
+        }
+        sqlite3_stmt* stmt;
+        if (sqlite3_prepare_v2(db, "SELECT start_ns, end_ns, file FROM partitions;", -1, &stmt, 0) != SQLITE_OK) {
+            std::cerr << "Error preparing statement: " << sqlite3_errmsg(db) << std::endl;
+            return -1;
+        }
+        while (sqlite3_step(stmt) == SQLITE_ROW) {
+            Partition& partition = catalog[sqlite3_column_int64(stmt, 0)];
+            partition.start = sqlite3_column_int64(stmt, 0);
+            partition.end = sqlite3_column_int64(stmt, 1);
+            partition.file = (const char*)sqlite3_column_text(stmt, 2);
+            // O nome do arquivo sem a extensão é único e é um identificador válido
+            partition.schema = "p" + partition.file.substr(partition.file.rfind('-') + 1);
+            partition.schema.resize(partition.schema.size() - 3);
+            partition.insertSQL = insertReadingSQL(partition.schema);
+        }
+        sqlite3_finalize(stmt);
+        return 0;
+    }
+
+    bool enabled() const {
+        return windowNs > 0;
+    }
+
+    // Pede que a partição que começa em start seja apagada; pode ser chamado
+    // de qualquer thread (o RetentionCompactor)
+    void retire(Timestamp start) {
+        std::lock_guard<std::mutex> lock(retiringMutex);
+        if (std::find(retiring.begin(), retiring.end(), start) == retiring.end()) {
+            retiring.push_back(start);
+        }
+    }
+
+    // Apaga as partições pedidas por retire(): desanexa, tira do catálogo
+    // (em memória e na tabela partitions) e remove os arquivos. Só na thread
+    // que usa a conexão global, fora de transação. Devolve quantas apagou.
+    int dropRetired() {
+        std::vector<Timestamp> starts;
+        {
+            std::lock_guard<std::mutex> lock(retiringMutex);
+            starts.swap(retiring);
+        }
+        int dropped = 0;
+        for (Timestamp start : starts) {
+            auto it = catalog.find(start);
+            if (it == catalog.end()) {
+                continue;
+            }
+            Partition& partition = it->second;
+            if (partition.attached && detach(partition) != 0) {
+                retire(start);
+                continue;
+            }
+            CachedStatement stmt = statementCache.get("DELETE FROM partitions WHERE start_ns = ?;");
+            if (!stmt.valid()) {
+                retire(start);
+                continue;
+            }
+            stmt.bind(1, (sqlite3_int64)start);
+            if (stmt.step() != SQLITE_DONE) {
+                std::cerr << "Error removing partition " << partition.file << ": " << sqlite3_errmsg(db) << std::endl;
+                retire(start);
+                continue;
+            }
+            const std::string file = partitionPath(databasePath, partition.file);
+            for (const char* suffix : {"", "-wal", "-shm", "-journal"}) {
+                std::remove((file + suffix).c_str());
+            }
+            std::cout << "RETENTION: dropped partition " << partition.file << std::endl;
+            expiredBefore = std::max(expiredBefore, partition.end);
+            catalog.erase(it);
+            dropped++;
+        }
+        return dropped;
+    }
+
+    // Instante de uma janela já apagada nesta execução: a leitura expirou
+    // para todos os sensores e não recria o arquivo
+    bool expired(Timestamp timestamp) {
+        return enabled() && timestamp < expiredBefore && !find(timestamp);
+    }
+
+    size_t size() const {
+        return catalog.size();
+    }
+
+    std::string newestPath() const {
+        return catalog.empty() ? std::string() : partitionPath(databasePath, catalog.rbegin()->second.file);
+    }
+
+    // Total de ATTACHs feitos, para medir a poda das consultas
+    uint64_t attachCount() const {
+        return attaches;
+    }
+
+    // Início da partição que recebe o instante: a que já o cobre ou a janela
+    // alinhada, recortada para não sobrepor partições criadas com outra
+    // duração de janela
+    Timestamp windowStart(Timestamp timestamp) {
+        Timestamp start = timestamp - ((timestamp % windowNs) + windowNs) % windowNs;
+        auto it = catalog.upper_bound(timestamp);
+        if (it != catalog.begin()) {
+            --it;
+            if (timestamp < it->second.end) {
+                return it->first;
+            }
+            start = std::max(start, it->second.end);
+        }
+        return start;
+    }
+
+    // Anexa (criando se preciso) as partições das janelas de um lote; precisa
+    // rodar fora de transação. Desanexa as usadas há mais tempo para ficar
+    // em até PARTITION_MAX_ATTACHED.
+    int prepare(const std::vector<Timestamp>& windows) {
+        useClock++;
+        for (Timestamp start : windows) {
+            Partition* partition = find(start);
+            if (!partition || !partition->attached) {
+                while (attachedCount >= PARTITION_MAX_ATTACHED) {
+                    if (detachLeastRecent() != 0) {
+                        return -1;
+                    }
+                }
+                if (!partition) {
+                    if (create(start) != 0) {
+                        return -1;
+                    }
+                    partition = &catalog[start];
+                } else if (attachForWriting(*partition) != 0) {
+                    return -1;
+                }
+            }
+            partition->lastUse = useClock;
+        }
+        return 0;
+    }
+
+
+    // INSERT da leitura na partição anexada que cobre o instante, ou nullptr
+    // se prepare() não anexou essa janela. Não cai em main.readings: lá a
+    // leitura escaparia da retenção por janela.
+    const std::string* insertSQL(Timestamp timestamp) {
+        if (!enabled()) {
+            return &INSERT_READING_SQL;
+        }
+        if (hot && timestamp >= hot->start && timestamp < hot->end) {
+            return &hot->insertSQL;
+        }
+        Partition* partition = find(timestamp);
+        if (partition && partition->attached) {
+            hot = partition;
+            return &partition->insertSQL;
+        }
+        return nullptr;
+    }
+
+    // fn(schema) para o banco principal e cada partição que cruza [from, to],
+    // do mais antigo para o mais novo (ou ao contrário com newestFirst). As
+    // partições que não estavam anexadas são anexadas uma de cada vez e
+    // desanexadas logo depois. fn devolve 0 para continuar, 1 para parar e
+    // -1 em caso de erro.
+    template <typename Fn>
+    int scan(Timestamp from, Timestamp to, bool newestFirst, Fn&& fn) {
+        std::vector<Partition*> selected;
+        for (auto& entry : catalog) {
+            if (entry.first <= to && entry.second.end > from) {
+                selected.push_back(&entry.second);
+            }
+        }
+        if (newestFirst) {
+            std::reverse(selected.begin(), selected.end());
+        } else {
+            int rc = fn(std::string("main"));
+            if (rc != 0) {
+                return rc < 0 ? -1 : 0;
+            }
+        }
+        for (Partition* partition : selected) {
+            bool wasAttached = partition->attached;
+            if (!wasAttached) {
+                // Arquivo já apagado pela retenção
+                if (!std::filesystem::exists(partitionPath(databasePath, partition->file))) {
+                    continue;
+                }
+                if (attach(*partition) != 0) {
+                    return -1;
+                }
+            }
+            int rc = fn(partition->schema);
+            if (!wasAttached && detach(*partition) != 0) {
+                return -1;
+            }
+            if (rc != 0) {
+                return rc < 0 ? -1 : 0;
+            }
+        }
+        return newestFirst && fn(std::string("main")) < 0 ? -1 : 0;
+    }
+
+    // Esquece o catálogo; as partições anexadas são fechadas junto com a
+    // conexão. Precisa ser chamado antes de sqlite3_close, como o StatementCache.
+    void clear() {
+        catalog.clear();
+        hot = nullptr;
+        attachedCount = 0;
+        windowNs = 0;
+        expiredBefore = std::numeric_limits<Timestamp>::min();
+    }
+};
+
+PartitionSet partitions;
+
+// Soma aos rollups as leituras de schema.readings ("main" ou uma partição
+// anexada) e registra a origem em rollup_backfill na mesma transação. Uma
+// origem já registrada é pulada.
+int backfillRollupSource(const std::string& schema) {
+    sqlite3_stmt* stmt;
+    if (sqlite3_prepare_v2(db, "SELECT 1 FROM rollup_backfill WHERE source = ?;", -1, &stmt, 0) != SQLITE_OK) {
+        std::cerr << "Error preparing statement: " << sqlite3_errmsg(db) << std::endl;
+        return -1;
+    }
+    sqlite3_bind_text(stmt, 1, schema.c_str(), -1, SQLITE_TRANSIENT);
+    bool done = sqlite3_step(stmt) == SQLITE_ROW;
+    sqlite3_finalize(stmt);
+    if (done) {
+        return 0;
+    }
+    std::string readings = schema + ".readings";
+    sqlite3_int64 rows = countRows(readings.c_str());
+    if (rows > 0) {
+        std::cout << "Building rollups for " << rows << " readings in " << schema << "..." << std::endl;
+    }
+    if (execSQL("BEGIN;") != 0) {
+        return -1;
+    }
+    for (const RollupLevel& level : ROLLUP_LEVELS) {
+        // Mesmo arredondamento para baixo de bucketStartOf (o % do SQLite
+        // também trunca em direção a zero). Um intervalo pode ter leituras
+        // em mais de uma origem, por isso o upsert.
+        std::string bucket = std::to_string(level.bucketNs);
+        std::string sql = std::string("INSERT INTO ") + level.table +
+            " (sensor, bucket_ns, min, max, sum, count, last_ns, last)"
+            " SELECT g.sensor, g.bucket_ns, g.min, g.max, g.sum, g.count, g.last_ns,"
+            " (SELECT value FROM " + readings + " r WHERE r.sensor = g.sensor AND r.timestamp_ns = g.last_ns)"
+            " FROM (SELECT sensor, timestamp_ns - ((timestamp_ns % " + bucket + ") + " + bucket + ") % " + bucket +
+            " AS bucket_ns, MIN(value) AS min, MAX(value) AS max, SUM(value) AS sum, COUNT(*) AS count,"
+            " MAX(timestamp_ns) AS last_ns FROM " + readings + " GROUP BY sensor, bucket_ns) g WHERE true" +
+            ROLLUP_MERGE_SQL;
+        if (execSQL(sql.c_str()) != 0) {
+            execSQL("ROLLBACK;");
+            return -1;
+        }
+    }
+    if (sqlite3_prepare_v2(db, "INSERT INTO rollup_backfill (source) VALUES (?);", -1, &stmt, 0) != SQLITE_OK) {
+        std::cerr << "Error preparing statement: " << sqlite3_errmsg(db) << std::endl;
+        execSQL("ROLLBACK;");
+        return -1;
+    }
+    sqlite3_bind_text(stmt, 1, schema.c_str(), -1, SQLITE_TRANSIENT);
+    int rc = sqlite3_step(stmt);
+    sqlite3_finalize(stmt);
+    if (rc != SQLITE_DONE) {
+        std::cerr << "Error recording rollup backfill of " << schema << ": " << sqlite3_errmsg(db) << std::endl;
+        execSQL("ROLLBACK;");
+        return -1;
+    }
+    return execSQL("COMMIT;");
+}
+
+// Preenche os rollups a partir das leituras já gravadas, no banco principal
+// e em cada partição, quando as tabelas acabaram de ser criadas em um banco
+// com dados. rollup_backfill existe enquanto falta alguma origem: uma
+// execução interrompida continua da origem seguinte.
+int backfillRollups() {
+    if (!tableExists("rollup_backfill")) {
+        return 0;
+    }
+    const char* path = sqlite3_db_filename(db, "main");
+    PartitionSet sources;
+    if (sources.open(path ? path : "", 0) != 0) {
+        return -1;
+    }
+    int rc = sources.scan(std::numeric_limits<Timestamp>::min(), std::numeric_limits<Timestamp>::max(), false,
+                          [](const std::string& schema) {
+        return backfillRollupSource(schema);
+    });
+    sources.clear();
+    if (rc != 0) {
+        return -1;
+    }
+    return execSQL("DROP TABLE rollup_backfill;");
+}
+
+// Esquema normalizado: máquinas, sensores e tipos de alarme são linhas das
+// tabelas de dimensão, e as leituras guardam só o id inteiro do sensor.
+// readings é WITHOUT ROWID, organizada pela própria chave primária: as
+// leituras de um sensor ficam contíguas e em ordem de tempo, e uma consulta
+// por faixa de tempo é uma busca na árvore em vez de uma varredura. Cada
+// alarme é um evento próprio (chave rowid), mesmo que repita máquina, tipo e
+// instante de outro; alarm_events_by_time e alarm_events_by_machine atendem
+// as consultas por período. As views sensor_data e alarms reproduzem as
+// colunas do esquema antigo para quem ainda consulta o banco por nome;
+// sensor_data só existe enquanto não há partições (uma view do banco
+// principal não enxerga os bancos anexados). As tabelas rollups_* são
+// descritas em ROLLUP_LEVELS.
+int createTables() {
+    const char* createTablesSQL = R"(
+        CREATE TABLE IF NOT EXISTS machines (
+            id INTEGER PRIMARY KEY,
+            name TEXT NOT NULL UNIQUE
+        );
+        CREATE TABLE IF NOT EXISTS sensors (
+            id INTEGER PRIMARY KEY,
+            machine INTEGER NOT NULL REFERENCES machines (id),
+            name TEXT NOT NULL,
+            UNIQUE (machine, name)
+        );
+        CREATE TABLE IF NOT EXISTS alarm_types (
+            id INTEGER PRIMARY KEY,
+            name TEXT NOT NULL UNIQUE
+        );
+        CREATE TABLE IF NOT EXISTS readings (
+            sensor INTEGER NOT NULL REFERENCES sensors (id),
+            timestamp_ns INTEGER NOT NULL,
+            value REAL,
+            PRIMARY KEY (sensor, timestamp_ns)
+        ) WITHOUT ROWID;
+        CREATE TABLE IF NOT EXISTS alarm_events (
+            id INTEGER PRIMARY KEY,
+            machine INTEGER NOT NULL REFERENCES machines (id),
+            alarm_type INTEGER NOT NULL REFERENCES alarm_types (id),
+            timestamp_ns INTEGER NOT NULL
+        );
+        CREATE INDEX IF NOT EXISTS alarm_events_by_time ON alarm_events (timestamp_ns);
+        CREATE INDEX IF NOT EXISTS alarm_events_by_machine ON alarm_events (machine, timestamp_ns);
+        CREATE TABLE IF NOT EXISTS rollups_1m (
+            sensor INTEGER NOT NULL REFERENCES sensors (id),
+            bucket_ns INTEGER NOT NULL,
+            min REAL, max REAL, sum REAL, count INTEGER, last_ns INTEGER, last REAL,
+            PRIMARY KEY (sensor, bucket_ns)
+        ) WITHOUT ROWID;
+        CREATE TABLE IF NOT EXISTS rollups_1h (
+            sensor INTEGER NOT NULL REFERENCES sensors (id),
+            bucket_ns INTEGER NOT NULL,
+            min REAL, max REAL, sum REAL, count INTEGER, last_ns INTEGER, last REAL,
+            PRIMARY KEY (sensor, bucket_ns)
+        ) WITHOUT ROWID;
+        CREATE TABLE IF NOT EXISTS rollups_1d (
+            sensor INTEGER NOT NULL REFERENCES sensors (id),
+            bucket_ns INTEGER NOT NULL,
+            min REAL, max REAL, sum REAL, count INTEGER, last_ns INTEGER, last REAL,
+            PRIMARY KEY (sensor, bucket_ns)
+        ) WITHOUT ROWID;
+        CREATE TABLE IF NOT EXISTS partitions (
+            start_ns INTEGER PRIMARY KEY,
+            end_ns INTEGER NOT NULL,
+            file TEXT NOT NULL
+        );
+    )";
+
+    const char* createReadingsViewSQL = R"(
+        CREATE VIEW IF NOT EXISTS sensor_data AS
+            SELECT m.name AS machine_id, s.name AS sensor_id, r.value AS value,
+                   strftime('%Y-%m-%dT%H:%M:%SZ', r.timestamp_ns / 1000000000, 'unixepoch') AS timestamp,
+                   r.timestamp_ns AS timestamp_ns
+            FROM readings r JOIN sensors s ON s.id = r.sensor JOIN machines m ON m.id = s.machine;
+    )";
+    const char* createViewsSQL = R"(
+        CREATE VIEW IF NOT EXISTS alarms AS
+            SELECT m.name AS machine_id, t.name AS alarm_type,
+                   strftime('%Y-%m-%dT%H:%M:%SZ', a.timestamp_ns / 1000000000, 'unixepoch') AS timestamp,
+                   a.timestamp_ns AS timestamp_ns
+            FROM alarm_events a JOIN machines m ON m.id = a.machine JOIN alarm_types t ON t.id = a.alarm_type;
+    )";
+    char* errorMessage;
+
+    // rollup_backfill vem antes dos rollups: se a criação for interrompida,
+    // o backfill ainda roda na próxima vez
+    bool hadRollups = tableExists("rollups_1m");
+    if (upgradeAlarmEvents() != 0 ||
+        (!hadRollups && execSQL("CREATE TABLE IF NOT EXISTS rollup_backfill (source TEXT PRIMARY KEY);") != 0)) {
+        return -1;
+    }
+    if (sqlite3_exec(db, createTablesSQL, 0, 0, &errorMessage) != SQLITE_OK) {
+        std::cerr << "Error creating tables: " << errorMessage << std::endl;
+        sqlite3_free(errorMessage);
+        return -1;
+    }
+
+    if (migrateLegacySchema() != 0 || backfillRollups() != 0) {
+        return -1;
+    }
+
+    if (countRows("partitions") > 0 ? execSQL("DROP VIEW IF EXISTS sensor_data;") != 0
+                                    : execSQL(createReadingsViewSQL) != 0) {
+        return -1;
+    }
+    if (sqlite3_exec(db, createViewsSQL, 0, 0, &errorMessage) != SQLITE_OK) {
+        std::cerr << "Error creating views: " << errorMessage << std::endl;
+        sqlite3_free(errorMessage);
+        return -1;
+    }
+    return 0;
+}
+
+const std::string INSERT_ALARM_SQL = "INSERT INTO alarm_events (machine, alarm_type, timestamp_ns) VALUES (?, ?, ?);";
+
+int insertSensorData(const std::string& machineId, const std::string& sensorId, float value, Timestamp timestamp) {
+    const std::string* sql = partitions.insertSQL(timestamp);
+    if (!sql) {
+        std::cerr << "No partition attached for reading at " << formatTimestamp(timestamp) << std::endl;
+        return -1;
+    }
+    sqlite3_int64 sensor = dimensionIds.sensor(machineId, sensorId);
+    CachedStatement stmt = statementCache.get(*sql);
+    if (sensor < 0 || !stmt.valid()) {
+        return -1;
+    }
+
+    stmt.bind(1, sensor);
+    stmt.bind(2, (sqlite3_int64)timestamp);
+    stmt.bind(3, value);
+
+    if (stmt.step() != SQLITE_DONE) {
+        std::cerr << "Error executing statement: " << sqlite3_errmsg(db) << std::endl;
+        return -1;
+    }
+    return 0;
+}
+
+int insertAlarm(const std::string& machineId, const std::string& alarmType, Timestamp timestamp) {
+    sqlite3_int64 machine = dimensionIds.machine(machineId);
+    sqlite3_int64 type = dimensionIds.alarmType(alarmType);
+    CachedStatement stmt = statementCache.get(INSERT_ALARM_SQL);
+    if (machine < 0 || type < 0 || !stmt.valid()) {
+        return -1;
+    }
+
+    stmt.bind(1, machine);
+    stmt.bind(2, type);
+    stmt.bind(3, (sqlite3_int64)timestamp);
+
+    if (stmt.step() != SQLITE_DONE) {
+        std::cerr << "Error executing statement: " << sqlite3_errmsg(db) << std::endl;
+        return -1;
+    }
+    return 0;
+}
+
+// Agregado de leituras de um sensor em um intervalo; o mesmo formato serve
+// as linhas dos rollups, o acumulador do lote e as consultas
+struct ReadingAggregate {
+    Timestamp bucketStart = 0;
+    double min = 0;
+    double max = 0;
+    double sum = 0;
+    int64_t count = 0;
+    Timestamp lastTimestamp = 0;
+    double last = 0;
+
+    void add(Timestamp timestamp, double value) {
+        if (count == 0 || value < min) {
+            min = value;
+        }
+        if (count == 0 || value > max) {
+            max = value;
+        }
+        if (count == 0 || timestamp >= lastTimestamp) {
+            lastTimestamp = timestamp;
+            last = value;
+        }
+        sum += value;
+        count++;
+    }
+
+    void merge(const ReadingAggregate& other) {
+        if (other.count == 0) {
+            return;
+        }
+        if (count == 0 || other.min < min) {
+            min = other.min;
+        }
+        if (count == 0 || other.max > max) {
+            max = other.max;
+        }
+        if (count == 0 || other.lastTimestamp >= lastTimestamp) {
+            lastTimestamp = other.lastTimestamp;
+            last = other.last;
+        }
+        sum += other.sum;
+        count += other.count;
+    }
+
+    double avg() const {
+        return count > 0 ? sum / count : 0.0;
+    }
+};
+
+// Rollups de um lote: um agregado por (sensor, intervalo) em cada nível,
+// somado em memória e gravado com upsert na mesma transação das leituras.
+// Uma leitura atrasada cai no intervalo dela e o upsert a junta ao que já
+// estava gravado. Só entram as leituras que o armazenamento aceitou: uma
+// repetida (mesmo sensor e instante) que o insert em readings ignorou, ou,
+// com --storage-engine=columnar, uma que o ColumnStore vai recusar, não é
+// somada.
+class RollupAccumulator {
+private:
+    std::map<std::pair<sqlite3_int64, Timestamp>, ReadingAggregate> pending[ROLLUP_LEVEL_COUNT];
+
+public:
+    void add(sqlite3_int64 sensor, Timestamp timestamp, double value) {
+        for (int i = 0; i < ROLLUP_LEVEL_COUNT; i++) {
+            Timestamp bucketStart = bucketStartOf(timestamp, ROLLUP_LEVELS[i].bucketNs);
+            ReadingAggregate& bucket = pending[i][{sensor, bucketStart}];
+            bucket.bucketStart = bucketStart;
+            bucket.add(timestamp, value);
+        }
+    }
+
+    int add(std::string_view machineId, std::string_view sensorId, Timestamp timestamp, double value) {
+        sqlite3_int64 sensor = dimensionIds.sensor(machineId, sensorId);
+        if (sensor < 0) {
+            return -1;
+        }
+        add(sensor, timestamp, value);
+        return 0;
+    }
+
+    // Grava tudo (na ordem da chave, que é a ordem da B-tree) e esvazia
+    int flush() {
+        for (int i = 0; i < ROLLUP_LEVEL_COUNT; i++) {
+            for (const auto& entry : pending[i]) {
+                const ReadingAggregate& bucket = entry.second;
+                CachedStatement stmt = statementCache.get(ROLLUP_LEVELS[i].upsertSQL);
+                if (!stmt.valid()) {
+                    return -1;
+                }
+                stmt.bind(1, entry.first.first);
+                stmt.bind(2, (sqlite3_int64)bucket.bucketStart);
+                stmt.bind(3, bucket.min);
+                stmt.bind(4, bucket.max);
+                stmt.bind(5, bucket.sum);
+                stmt.bind(6, (sqlite3_int64)bucket.count);
+                stmt.bind(7, (sqlite3_int64)bucket.lastTimestamp);
+                stmt.bind(8, bucket.last);
+                if (stmt.step() != SQLITE_DONE) {
+                    std::cerr << "Error updating " << ROLLUP_LEVELS[i].table << ": " << sqlite3_errmsg(db) << std::endl;
+                    return -1;
+                }
+            }
+            pending[i].clear();
+        }
+        return 0;
+    }
+
+    void clear() {
+        for (auto& level : pending) {
+            level.clear();
+        }
+    }
+};
+
+// Perfis de configuração do banco. DEFAULT mantém o comportamento original
+// do SQLite (rollback journal, fsync completo); TUNED usa WAL, que deixa
+// leitores (dashboards) consultarem enquanto o processador grava.
+enum class StorageProfile {
+    DEFAULT,
+    TUNED
+};
+
+bool parseStorageProfile(const std::string& name, StorageProfile& profile) {
+    if (name == "default") {
+        profile = StorageProfile::DEFAULT;
+    } else if (name == "tuned") {
+        profile = StorageProfile::TUNED;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+// Aplica o perfil na conexão global. No perfil TUNED o synchronous=NORMAL
+// em WAL não corrompe o banco; uma queda de energia pode perder apenas as
+// últimas transações confirmadas, mesma ordem de grandeza do lote em memória.
+// O checkpoint automático é desligado porque o CheckpointScheduler cuida disso.
+int configureStorage(StorageProfile profile) {
+    // Sem isso um leitor externo faz o COMMIT falhar com "database is locked"
+    sqlite3_busy_timeout(db, BUSY_TIMEOUT_MS);
+    if (profile == StorageProfile::DEFAULT) {
+        return execSQL("PRAGMA journal_mode=DELETE;");
+    }
+    const char* pragmas[] = {
+        "PRAGMA journal_mode=WAL;",
+        "PRAGMA synchronous=NORMAL;",
+        "PRAGMA cache_size=-65536;",      // 64 MiB
+        "PRAGMA mmap_size=268435456;",    // 256 MiB
+        "PRAGMA temp_store=MEMORY;",
+        "PRAGMA wal_autocheckpoint=0;",
+    };
+    for (const char* pragma : pragmas) {
+        if (execSQL(pragma) != 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+// Checkpoint do WAL em segundo plano, em uma conexão própria. A cada
+// CHECKPOINT_INTERVAL_MS roda um checkpoint PASSIVE (não bloqueia leitores
+// nem o escritor); se o WAL passar de WAL_TRUNCATE_FRAMES páginas, roda um
+// TRUNCATE para devolver o arquivo ao tamanho zero. Com partições, as
+// PARTITION_CHECKPOINT_COUNT mais novas (as que recebem inserts) ficam
+// anexadas a esta conexão e são checkpointadas junto; a conexão global tem o
+// checkpoint automático desligado para todos os arquivos.
+class CheckpointScheduler {
+private:
+    std::string path;
+    std::chrono::milliseconds interval;
+    sqlite3* conn = nullptr;
+    std::atomic<bool> running;
+    std::thread worker;
+    std::map<Timestamp, std::string> attachedPartitions; // início da janela -> schema
+    int nextSchema = 0;
+
+    // Acompanha as partições mais novas do catálogo
+    void attachNewestPartitions() {
+        sqlite3_stmt* stmt;
+        if (sqlite3_prepare_v2(conn, "SELECT start_ns, file FROM main.partitions ORDER BY start_ns DESC LIMIT ?;",
+                               -1, &stmt, 0) != SQLITE_OK) {
+            return; // banco sem catálogo de partições
+        }
+        sqlite3_bind_int(stmt, 1, PARTITION_CHECKPOINT_COUNT);
+        std::map<Timestamp, std::string> newest;
+        while (sqlite3_step(stmt) == SQLITE_ROW) {
+            newest[sqlite3_column_int64(stmt, 0)] = (const char*)sqlite3_column_text(stmt, 1);
+        }
+        sqlite3_finalize(stmt);
+
+        for (auto it = attachedPartitions.begin(); it != attachedPartitions.end();) {
+            if (newest.count(it->first) == 0) {
+                sqlite3_exec(conn, ("DETACH DATABASE " + it->second + ";").c_str(), 0, 0, 0);
+                it = attachedPartitions.erase(it);
+            } else {
+                ++it;
+            }
+        }
+        for (const auto& entry : newest) {
+            std::string file = partitionPath(path, entry.second);
+            if (attachedPartitions.count(entry.first) > 0 || !std::filesystem::exists(file)) {
+                continue;
+            }
+            std::string schema = "partition_" + std::to_string(nextSchema++);
+            if (sqlite3_prepare_v2(conn, ("ATTACH DATABASE ? AS " + schema + ";").c_str(), -1, &stmt, 0) != SQLITE_OK) {
+                continue;
+            }
+            sqlite3_bind_text(stmt, 1, file.c_str(), -1, SQLITE_TRANSIENT);
+            if (sqlite3_step(stmt) == SQLITE_DONE) {
+                attachedPartitions[entry.first] = schema;
+            }
+            sqlite3_finalize(stmt);
+        }
+    }
+
+    void checkpoint(int mode) {
+        int logFrames = 0;
+        int checkpointedFrames = 0;
+        int rc = sqlite3_wal_checkpoint_v2(conn, nullptr, mode, &logFrames, &checkpointedFrames);
+        if (rc != SQLITE_OK && rc != SQLITE_BUSY) {
+            std::cerr << "Error running WAL checkpoint: " << sqlite3_errmsg(conn) << std::endl;
+            return;
+        }
+        if (mode == SQLITE_CHECKPOINT_PASSIVE && logFrames > WAL_TRUNCATE_FRAMES) {
+            checkpoint(SQLITE_CHECKPOINT_TRUNCATE);
+        }
+    }
+
+    void run() {
+        while (running) {
+            auto next = std::chrono::steady_clock::now() + interval;
+            while (running && std::chrono::steady_clock::now() < next) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(50));
+            }
+            attachNewestPartitions();
+            checkpoint(SQLITE_CHECKPOINT_PASSIVE);
+        }
+    }
+
+public:
+    CheckpointScheduler(const std::string& databasePath, std::chrono::milliseconds checkpointInterval)
+        : path(databasePath), interval(checkpointInterval), running(false) {}
+
+    ~CheckpointScheduler() {
+        stop();
+    }
+
+    int start() {
+        if (sqlite3_open(path.c_str(), &conn) != SQLITE_OK) {
+            std::cerr << "Error opening checkpoint connection: " << sqlite3_errmsg(conn) << std::endl;
+            sqlite3_close(conn);
+            conn = nullptr;
+            return -1;
+        }
+        sqlite3_busy_timeout(conn, BUSY_TIMEOUT_MS);
+        running = true;
+        worker = std::thread(&CheckpointScheduler::run, this);
+        return 0;
+    }
+
+    // Para a thread e deixa o WAL vazio
+    void stop() {
+        running = false;
+        if (worker.joinable()) {
+            worker.join();
+        }
+        if (conn) {
+            attachNewestPartitions();
+            checkpoint(SQLITE_CHECKPOINT_TRUNCATE);
+            sqlite3_close(conn);
+            conn = nullptr;
+            attachedPartitions.clear();
+        }
+    }
+};
+
+// Retenção: por quanto tempo cada tabela guarda dados (0 = para sempre),
+// com exceções por sensor para as leituras brutas. Configurada com
+// --retention=<alvo>=<duração>, onde o alvo é readings, rollups_1m,
+// rollups_1h, rollups_1d, alarms ou <machine_id>/<sensor_id>.
+struct RetentionPolicy {
+    int64_t readingsNs = 0;
+    int64_t rollupNs[ROLLUP_LEVEL_COUNT] = {0, 0, 0};
+    int64_t alarmsNs = 0;
+    std::map<std::string, int64_t> sensorReadingsNs; // "<machine_id>/<sensor_id>"
+
+    bool empty() const {
+        bool anyRollup = false;
+        for (int64_t retention : rollupNs) {
+            anyRollup = anyRollup || retention > 0;
+        }
+        return readingsNs == 0 && !anyRollup && alarmsNs == 0 && sensorReadingsNs.empty();
+    }
+};
+
+bool parseRetention(const std::string& spec, RetentionPolicy& policy) {
+    size_t equals = spec.rfind('=');
+    int64_t retention;
+    if (equals == std::string::npos || !parseDuration(std::string_view(spec).substr(equals + 1), retention)) {
+        return false;
+    }
+    std::string target = spec.substr(0, equals);
+    if (target == "readings") {
+        policy.readingsNs = retention;
+    } else if (target == "alarms") {
+        policy.alarmsNs = retention;
+    } else if (target.find('/') != std::string::npos) {
+        policy.sensorReadingsNs[target] = retention;
+    } else {
+        for (int i = 0; i < ROLLUP_LEVEL_COUNT; i++) {
+            if (target == ROLLUP_LEVELS[i].table) {
+                policy.rollupNs[i] = retention;
+                return true;
+            }
+        }
+        return false;
+    }
+    return true;
+}
+
+// Aplica a retenção em segundo plano, em uma conexão própria, como o
+// CheckpointScheduler. A cada RETENTION_INTERVAL_MS apaga o que expirou,
+// sensor a sensor, em DELETEs de até RETENTION_CHUNK_ROWS linhas pela chave
+// primária (sensor, tempo), cada um na sua transação e com uma pausa entre
+// eles: o lock de escrita fica livre para o BatchWriter quase o tempo todo.
+// As páginas liberadas são reaproveitadas por inserts novos; o arquivo não
+// encolhe. Com partições, uma janela que expirou para todos os sensores é
+// entregue a PartitionSet::retire, e o BatchWriter a desanexa e apaga o
+// arquivo de uma vez; nas que expiraram só
+// em parte (ou só para alguns sensores) os DELETEs em blocos rodam dentro do
+// arquivo da partição.
+class RetentionCompactor {
+private:
+    std::string path;
+    RetentionPolicy policy;
+    std::chrono::milliseconds interval;
+    int chunkRows;
+    sqlite3* conn = nullptr;
+    std::atomic<bool> running;
+    std::atomic<uint64_t> deletedRows;
+    std::atomic<uint64_t> completedPasses;
+    std::thread worker;
+
+    // Apaga, em blocos, as linhas de um sensor (ou de toda a tabela, se
+    // sensor < 0) com tempo anterior a cutoff. O limite de cada bloco é o
+    // tempo da chunkRows-ésima linha mais antiga.
+    uint64_t deleteOlder(const char* table, const char* timeColumn, sqlite3_int64 sensor, Timestamp cutoff) {
+        std::string t(table);
+        std::string c(timeColumn);
+        std::string sensorFilter = sensor >= 0 ? "sensor = ?3 AND " : "";
+        std::string sql = "DELETE FROM " + t + " WHERE " + sensorFilter + c + " <= COALESCE((SELECT " + c +
+                          " FROM " + t + " WHERE " + sensorFilter + c + " < ?1 ORDER BY " + c +
+                          " LIMIT 1 OFFSET ?2), ?1 - 1);";
+        sqlite3_stmt* stmt;
+        if (sqlite3_prepare_v2(conn, sql.c_str(), -1, &stmt, 0) != SQLITE_OK) {
+            std::cerr << "Error preparing retention statement: " << sqlite3_errmsg(conn) << std::endl;
+            return 0;
+        }
+        sqlite3_bind_int64(stmt, 1, cutoff);
+        sqlite3_bind_int(stmt, 2, chunkRows - 1);
+        if (sensor >= 0) {
+            sqlite3_bind_int64(stmt, 3, sensor);
+        }
+        uint64_t deleted = 0;
+        while (running) {
+            if (sqlite3_step(stmt) != SQLITE_DONE) {
+                std::cerr << "Error applying retention to " << table << ": " << sqlite3_errmsg(conn) << std::endl;
+                break;
+            }
+            sqlite3_reset(stmt);
+            int changes = sqlite3_changes(conn);
+            deleted += changes;
+            if (changes < chunkRows) {
+                break;
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(RETENTION_CHUNK_PAUSE_MS));
+        }
+        sqlite3_finalize(stmt);
+        return deleted;
+    }
+
+    // Sensores com o nome completo, para as exceções por sensor
+    std::vector<std::pair<sqlite3_int64, std::string>> listSensors() {
+        std::vector<std::pair<sqlite3_int64, std::string>> sensors;
+        sqlite3_stmt* stmt;
+        if (sqlite3_prepare_v2(conn, "SELECT s.id, m.name || '/' || s.name FROM sensors s"
+                                     " JOIN machines m ON m.id = s.machine;", -1, &stmt, 0) != SQLITE_OK) {
+            std::cerr << "Error preparing statement: " << sqlite3_errmsg(conn) << std::endl;
+            return sensors;
+        }
+        while (sqlite3_step(stmt) == SQLITE_ROW) {
+            sensors.emplace_back(sqlite3_column_int64(stmt, 0), (const char*)sqlite3_column_text(stmt, 1));
+        }
+        sqlite3_finalize(stmt);
+        return sensors;
+    }
+
+    // Leituras expiradas de uma tabela readings (do banco principal ou de
+    // uma partição anexada), com a retenção de cada sensor
+    uint64_t expireReadings(const std::string& table, const std::vector<std::pair<sqlite3_int64, std::string>>& sensors,
+                            Timestamp now) {
+        uint64_t deleted = 0;
+        for (const auto& sensor : sensors) {
+            auto exception = policy.sensorReadingsNs.find(sensor.second);
+            int64_t retention = exception != policy.sensorReadingsNs.end() ? exception->second : policy.readingsNs;
+            if (retention > 0) {
+                deleted += deleteOlder(table.c_str(), "timestamp_ns", sensor.first, now - retention);
+            }
+        }
+        return deleted;
+    }
+
+    // Partições cuja janela inteira expirou para todos os sensores são
+    // entregues ao BatchWriter (retire), dono do catálogo e da conexão que
+    // pode tê-las anexadas; nas que começam antes da menor retenção, DELETE
+    // em blocos.
+    uint64_t expirePartitions(const std::vector<std::pair<sqlite3_int64, std::string>>& sensors, Timestamp now) {
+        int64_t shortest = policy.readingsNs;
+        int64_t longest = policy.readingsNs;
+        for (const auto& exception : policy.sensorReadingsNs) {
+            if (shortest == 0 || (exception.second > 0 && exception.second < shortest)) {
+                shortest = exception.second;
+            }
+            longest = longest == 0 || exception.second == 0 ? 0 : std::max(longest, exception.second);
+        }
+        if (shortest == 0) {
+            return 0;
+        }
+
+        std::vector<std::pair<Timestamp, Timestamp>> windows;
+        std::vector<std::string> files;
+        sqlite3_stmt* stmt;
+        if (sqlite3_prepare_v2(conn, "SELECT start_ns, end_ns, file FROM partitions WHERE start_ns < ? ORDER BY start_ns;",
+                               -1, &stmt, 0) != SQLITE_OK) {
+            std::cerr << "Error preparing statement: " << sqlite3_errmsg(conn) << std::endl;
+            return 0;
+        }
+        sqlite3_bind_int64(stmt, 1, now - shortest);
+        while (sqlite3_step(stmt) == SQLITE_ROW) {
+            windows.emplace_back(sqlite3_column_int64(stmt, 0), sqlite3_column_int64(stmt, 1));
+            files.push_back((const char*)sqlite3_column_text(stmt, 2));
+        }
+        sqlite3_finalize(stmt);
+
+        uint64_t deleted = 0;
+        for (size_t i = 0; i < files.size() && running; i++) {
+            const std::string file = partitionPath(path, files[i]);
+            if (longest > 0 && windows[i].second <= now - longest) {
+                partitions.retire(windows[i].first);
+                continue;
+            }
+            if (!std::filesystem::exists(file) ||
+                sqlite3_prepare_v2(conn, "ATTACH DATABASE ? AS expiring;", -1, &stmt, 0) != SQLITE_OK) {
+                continue;
+            }
+            sqlite3_bind_text(stmt, 1, file.c_str(), -1, SQLITE_TRANSIENT);
+            int rc = sqlite3_step(stmt);
+            sqlite3_finalize(stmt);
+            if (rc != SQLITE_DONE) {
+                std::cerr << "Error attaching partition " << file << ": " << sqlite3_errmsg(conn) << std::endl;
+                continue;
+            }
+            deleted += expireReadings("expiring.readings", sensors, now);
+            sqlite3_exec(conn, "DETACH DATABASE expiring;", 0, 0, 0);
+        }
+        return deleted;
+    }
+
+    void compact() {
+        const Timestamp now = currentTimestamp();
+        const auto sensors = listSensors();
+        uint64_t deleted = expireReadings("readings", sensors, now) + expirePartitions(sensors, now);
+        for (const auto& sensor : sensors) {
+            for (int i = 0; i < ROLLUP_LEVEL_COUNT; i++) {
+                if (policy.rollupNs[i] > 0) {
+                    deleted += deleteOlder(ROLLUP_LEVELS[i].table, "bucket_ns", sensor.first, now - policy.rollupNs[i]);
+                }
+            }
+        }
+        if (policy.alarmsNs > 0) {
+            deleted += deleteOlder("alarm_events", "timestamp_ns", -1, now - policy.alarmsNs);
+        }
+        if (deleted > 0) {
+            std::cout << "RETENTION: deleted " << deleted << " expired rows" << std::endl;
+        }
+        deletedRows += deleted;
+        completedPasses++;
+    }
+
+    void run() {
+        while (running) {
+            compact();
+            auto next = std::chrono::steady_clock::now() + interval;
+            while (running && std::chrono::steady_clock::now() < next) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(50));
+            }
+        }
+    }
+
+public:
+    RetentionCompactor(const std::string& databasePath, const RetentionPolicy& retention,
+                       std::chrono::milliseconds compactInterval, int rowsPerChunk = RETENTION_CHUNK_ROWS)
+        : path(databasePath), policy(retention), interval(compactInterval), chunkRows(rowsPerChunk),
+          running(false), deletedRows(0), completedPasses(0) {}
+
+    ~RetentionCompactor() {
+        stop();
+    }
+
+    int start() {
+        if (sqlite3_open(path.c_str(), &conn) != SQLITE_OK) {
+            std::cerr << "Error opening retention connection: " << sqlite3_errmsg(conn) << std::endl;
+            sqlite3_close(conn);
+            conn = nullptr;
+            return -1;
+        }
+        sqlite3_busy_timeout(conn, BUSY_TIMEOUT_MS);
+        running = true;
+        worker = std::thread(&RetentionCompactor::run, this);
+        return 0;
+    }
+
+    uint64_t deleted() const {
+        return deletedRows.load();
+    }
+
+    uint64_t passes() const {
+        return completedPasses.load();
+    }
+
+    // Interrompe a passada em andamento entre dois blocos
+    void stop() {
+        running = false;
+        if (worker.joinable()) {
+            worker.join();
+        }
+        if (conn) {
+            sqlite3_close(conn);
+            conn = nullptr;
+        }
+    }
+};
+
+// Onde as leituras de sensor são gravadas. Os alarmes continuam sempre no
+// SQLite; BOTH grava as leituras nos dois, útil durante a transição.
+enum class StorageEngine {
+    SQLITE,
+    COLUMNAR,
+    BOTH
+};
+
+bool parseStorageEngine(const std::string& name, StorageEngine& engine) {
+    if (name == "sqlite") {
+        engine = StorageEngine::SQLITE;
+    } else if (name == "columnar") {
+        engine = StorageEngine::COLUMNAR;
+    } else if (name == "both") {
+        engine = StorageEngine::BOTH;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+// Armazenamento colunar de séries temporais. Cada sensor tem um arquivo
+// próprio em COLUMN_STORE_DIR, formado por uma sequência de blocos de até
+// COLUMN_BLOCK_READINGS leituras. Cada bloco tem um cabeçalho fixo (faixa
+// de tempo e de valores, usada para podar consultas) seguido de um fluxo de
+// bits com os timestamps em delta-of-delta e os valores float32 em XOR com
+// o anterior (esquema do Gorilla, do Facebook). Só o último bloco de cada
+// arquivo fica aberto: ele é reescrito no lugar a cada sync() até encher.
+// O cabeçalho é gravado na ordem de bytes da máquina (little-endian nos
+// alvos do projeto).
+const uint32_t COLUMN_BLOCK_MAGIC = 0x31424353; // "SCB1"
+const uint16_t COLUMN_BLOCK_OPEN = 1; // bloco da cauda, ainda recebe leituras
+
+struct ColumnBlockHeader {
+    uint32_t magic;
+    uint16_t flags;
+    uint16_t count;
+    int64_t unitNs; // resolução dos timestamps do bloco (1 s, 1 ms, 1 us ou 1 ns)
+    Timestamp minTimestamp;
+    Timestamp maxTimestamp;
+    float minValue;
+    float maxValue;
+    uint32_t payloadBytes;
+    uint32_t checksum; // FNV-1a do cabeçalho (com checksum = 0) e do payload
+};
+
+static_assert(sizeof(ColumnBlockHeader) == 48, "ColumnBlockHeader must have no padding");
+
+uint32_t columnBlockChecksum(ColumnBlockHeader header, const uint8_t* payload) {
+    header.checksum = 0;
+    uint32_t hash = 2166136261u;
+    auto mix = [&](const uint8_t* data, size_t size) {
+        for (size_t i = 0; i < size; i++) {
+            hash = (hash ^ data[i]) * 16777619u;
+        }
+    };
+    mix((const uint8_t*)&header, sizeof(header));
+    mix(payload, header.payloadBytes);
+    return hash;
+}
+
+// Acumula campos de largura arbitrária, do bit mais significativo para o menos
+class BitWriter {
+private:
+    std::vector<uint8_t> bytes;
+    size_t bitCount = 0;
+
+public:
+    void write(uint64_t value, int bits) {
+        while (bits > 0) {
+            int used = bitCount % 8;
+            if (used == 0) {
+                bytes.push_back(0);
+            }
+            int take = std::min(8 - used, bits);
+            uint8_t chunk = (uint8_t)((value >> (bits - take)) & ((1u << take) - 1));
+            bytes.back() |= (uint8_t)(chunk << (8 - used - take));
+            bits -= take;
+            bitCount += take;
+        }
+    }
+
+    const std::vector<uint8_t>& data() const {
+        return bytes;
+    }
+
+    void clear() {
+        bytes.clear();
+        bitCount = 0;
+    }
+};
+
+class BitReader {
+private:
+    const uint8_t* data;
+    size_t bitCount;
+    size_t position = 0;
+
+public:
+    BitReader(const uint8_t* bytes, size_t size) : data(bytes), bitCount(size * 8) {}
+
+    // false se o fluxo acabar antes do campo (bloco truncado ou corrompido)
+    bool read(int bits, uint64_t& out) {
+        if (position + bits > bitCount) {
+            return false;
+        }
+        out = 0;
+        while (bits > 0) {
+            int used = position % 8;
+            int take = std::min(8 - used, bits);
+            out = (out << take) | ((data[position / 8] >> (8 - used - take)) & ((1u << take) - 1));
+            bits -= take;
+            position += take;
+        }
+        return true;
+    }
+};
+
+// Codifica as leituras de um bloco. O primeiro timestamp (em unidades de
+// unitNs) e o primeiro valor vão por extenso; os seguintes usam:
+//   timestamp: delta-of-delta em '0' | '10'+7 bits | '110'+9 | '1110'+12 | '1111'+64
+//   valor: XOR com o anterior em '0' (igual) | '10'+bits úteis na janela
+//          anterior | '11'+5 bits de zeros à esquerda+5 bits de tamanho+bits úteis
+// Leituras periódicas com poucas casas decimais ficam em poucos bits cada.
+class ColumnBlockEncoder {
+private:
+    BitWriter bits;
+    ColumnBlockHeader header{};
+    int64_t lastUnits = 0;
+    int64_t lastDelta = 0;
+    uint32_t lastValue = 0;
+    int leading = -1; // janela do último XOR gravado por extenso (-1: nenhuma)
+    int trailing = 0;
+
+    void writeTimestamp(int64_t units) {
+        if (header.count == 0) {
+            bits.write((uint64_t)units, 64);
+            return;
+        }
+        int64_t delta = units - lastUnits;
+        int64_t deltaOfDelta = delta - lastDelta;
+        if (deltaOfDelta == 0) {
+            bits.write(0, 1);
+        } else if (deltaOfDelta >= -63 && deltaOfDelta <= 64) {
+            bits.write(0x2, 2);
+            bits.write((uint64_t)(deltaOfDelta + 63), 7);
+        } else if (deltaOfDelta >= -255 && deltaOfDelta <= 256) {
+            bits.write(0x6, 3);
+            bits.write((uint64_t)(deltaOfDelta + 255), 9);
+        } else if (deltaOfDelta >= -2047 && deltaOfDelta <= 2048) {
+            bits.write(0xe, 4);
+            bits.write((uint64_t)(deltaOfDelta + 2047), 12);
+        } else {
+            bits.write(0xf, 4);
+            bits.write((uint64_t)deltaOfDelta, 64);
+        }
+        lastDelta = delta;
+    }
+
+    void writeValue(uint32_t value) {
+        if (header.count == 0) {
+            bits.write(value, 32);
+            return;
+        }
+        uint32_t xored = value ^ lastValue;
+        if (xored == 0) {
+            bits.write(0, 1);
+            return;
+        }
+        int leadingZeros = __builtin_clz(xored);
+        int trailingZeros = __builtin_ctz(xored);
+        if (leading >= 0 && leadingZeros >= leading && trailingZeros >= trailing) {
+            bits.write(0x2, 2);
+            bits.write(xored >> trailing, 32 - leading - trailing);
+        } else {
+            int meaningful = 32 - leadingZeros - trailingZeros;
+            bits.write(0x3, 2);
+            bits.write(leadingZeros, 5);
+            bits.write(meaningful - 1, 5);
+            bits.write(xored >> trailingZeros, meaningful);
+            leading = leadingZeros;
+            trailing = trailingZeros;
+        }
+    }
+
+public:
+    size_t count() const {
+        return header.count;
+    }
+
+    // O bloco recusa a leitura quando está cheio ou quando o timestamp não
+    // cabe na resolução escolhida pela primeira leitura
+    bool accepts(Timestamp timestamp) const {
+        return header.count == 0 || (header.count < COLUMN_BLOCK_READINGS && timestamp % header.unitNs == 0);
+    }
+
+    void append(Timestamp timestamp, float value) {
+        uint32_t valueBits;
+        std::memcpy(&valueBits, &value, sizeof(valueBits));
+        if (header.count == 0) {
+            header.unitNs = 1;
+            for (int64_t unit : {NANOS_PER_SECOND, (Timestamp)1000000, (Timestamp)1000}) {
+                if (timestamp % unit == 0) {
+                    header.unitNs = unit;
+                    break;
+                }
+            }
+            header.minTimestamp = header.maxTimestamp = timestamp;
+            header.minValue = header.maxValue = value;
+        } else {
+            header.minTimestamp = std::min(header.minTimestamp, timestamp);
+            header.maxTimestamp = std::max(header.maxTimestamp, timestamp);
+            header.minValue = std::min(header.minValue, value);
+            header.maxValue = std::max(header.maxValue, value);
+        }
+        int64_t units = timestamp / header.unitNs;
+        writeTimestamp(units);
+        writeValue(valueBits);
+        lastUnits = units;
+        lastValue = valueBits;
+        header.count++;
+    }
+
+    ColumnBlockHeader finish(uint16_t flags) const {
+        ColumnBlockHeader out = header;
+        out.magic = COLUMN_BLOCK_MAGIC;
+        out.flags = flags;
+        out.payloadBytes = (uint32_t)bits.data().size();
+        out.checksum = columnBlockChecksum(out, bits.data().data());
+        return out;
+    }
+
+    const std::vector<uint8_t>& payload() const {
+        return bits.data();
+    }
+
+    void clear() {
+        bits.clear();
+        header = ColumnBlockHeader{};
+        lastUnits = 0;
+        lastDelta = 0;
+        lastValue = 0;
+        leading = -1;
+        trailing = 0;
+    }
+};
+
+// Decodifica um bloco chamando fn(timestamp, valor) para cada leitura, na
+// ordem de chegada. Devolve false se o fluxo de bits for inválido.
+template <typename Fn>
+bool decodeColumnBlock(const ColumnBlockHeader& header, const uint8_t* payload, Fn&& fn) {
+    BitReader in(payload, header.payloadBytes);
+    int64_t units = 0;
+    int64_t delta = 0;
+    uint32_t value = 0;
+    int leading = 0;
+    int trailing = 0;
+    uint64_t field;
+    for (uint16_t i = 0; i < header.count; i++) {
+        if (i == 0) {
+            if (!in.read(64, field)) {
+                return false;
+            }
+            units = (int64_t)field;
+            if (!in.read(32, field)) {
+                return false;
+            }
+            value = (uint32_t)field;
+        } else {
+            int prefix = 0;
+            while (prefix < 4) {
+                if (!in.read(1, field)) {
+                    return false;
+                }
+                if (field == 0) {
+                    break;
+                }
+                prefix++;
+            }
+            static const int widths[] = {0, 7, 9, 12, 64};
+            static const int64_t biases[] = {0, 63, 255, 2047, 0};
+            if (prefix > 0) {
+                if (!in.read(widths[prefix], field)) {
+                    return false;
+                }
+                delta += (int64_t)field - biases[prefix];
+            }
+            units += delta;
+
+            if (!in.read(1, field)) {
+                return false;
+            }
+            if (field == 1) {
+                if (!in.read(1, field)) {
+                    return false;
+                }
+                if (field == 1) {
+                    uint64_t leadingBits, sizeBits;
+                    if (!in.read(5, leadingBits) || !in.read(5, sizeBits)) {
+                        return false;
+                    }
+                    leading = (int)leadingBits;
+                    trailing = 32 - leading - (int)sizeBits - 1;
+                    if (trailing < 0) {
+                        return false;
+                    }
+                }
+                if (!in.read(32 - leading - trailing, field)) {
+                    return false;
+                }
+                value ^= (uint32_t)(field << trailing);
+            }
+        }
+        float decoded;
+        std::memcpy(&decoded, &value, sizeof(decoded));
+        fn(units * header.unitNs, decoded);
+    }
+    return true;
+}
+
+// Nome do arquivo de uma série: "<machine_id>.<sensor_id>.col", com todo
+// byte fora de [A-Za-z0-9_-] escrito como %XX, para que um id qualquer não
+// saia do diretório nem colida com outro
+std::string columnFileName(std::string_view machineId, std::string_view sensorId) {
+    std::string name;
+    auto escape = [&](std::string_view id) {
+        for (unsigned char c : id) {
+            if ((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '_' || c == '-') {
+                name += (char)c;
+            } else {
+                char hex[4];
+                std::snprintf(hex, sizeof(hex), "%%%02X", c);
+                name += hex;
+            }
+        }
+    };
+    escape(machineId);
+    name += '.';
+    escape(sensorId);
+    name += ".col";
+    return name;
+}
+
+struct ColumnBlockRef {
+    uint64_t offset;
+    ColumnBlockHeader header;
+};
+
+// Um arquivo de série. Ao abrir, percorre a cadeia de cabeçalhos e monta o
+// índice de blocos em memória; se o último bloco estiver aberto e o arquivo
+// for de escrita, suas leituras voltam para o codificador da cauda. Um
+// bloco final cortado por uma queda (cabeçalho ou checksum inválido) é
+// descartado. Cada série só cresce em ordem de tempo: uma leitura com
+// timestamp igual ou anterior ao mais novo já gravado é recusada, o que
+// também descarta reentregas. sync() só chega ao page cache: sobrevive à
+// queda do processo, não à de energia, e uma queda no meio da reescrita
+// pode perder o bloco aberto. close() faz o fsync.
+class ColumnSeries {
+private:
+    std::string path;
+    int fd = -1;
+    bool writable = false;
+    std::vector<ColumnBlockRef> blocks;
+    ColumnBlockEncoder tail;
+    uint64_t tailOffset = 0;
+    bool dirty = false;
+    bool hasReadings = false;
+    Timestamp newestTimestamp = 0;
+    std::vector<uint8_t> buffer;
+
+    int writeBlock(uint16_t flags) {
+        ColumnBlockHeader header = tail.finish(flags);
+        buffer.resize(sizeof(header) + header.payloadBytes);
+        std::memcpy(buffer.data(), &header, sizeof(header));
+        std::memcpy(buffer.data() + sizeof(header), tail.payload().data(), header.payloadBytes);
+        if (pwrite(fd, buffer.data(), buffer.size(), (off_t)tailOffset) != (ssize_t)buffer.size()) {
+            std::cerr << "Error writing column file " << path << ": " << std::strerror(errno) << std::endl;
+            return -1;
+        }
+        if (flags == 0) {
+            blocks.push_back({tailOffset, header});
+            tailOffset += buffer.size();
+            tail.clear();
+        }
+        dirty = false;
+        return 0;
+    }
+
+    bool readPayload(const ColumnBlockHeader& header, uint64_t offset) {
+        buffer.resize(header.payloadBytes);
+        return pread(fd, buffer.data(), header.payloadBytes, (off_t)(offset + sizeof(header))) == (ssize_t)header.payloadBytes &&
+               columnBlockChecksum(header, buffer.data()) == header.checksum;
+    }
+
+public:
+    ~ColumnSeries() {
+        close();
+    }
+
+    int open(const std::string& filePath, bool forWriting) {
+        path = filePath;
+        writable = forWriting;
+        fd = ::open(path.c_str(), writable ? O_RDWR | O_CREAT : O_RDONLY, 0644);
+        if (fd < 0) {
+            std::cerr << "Error opening column file " << path << ": " << std::strerror(errno) << std::endl;
+            return -1;
+        }
+        struct stat info;
+        if (fstat(fd, &info) != 0) {
+            std::cerr << "Error reading column file " << path << ": " << std::strerror(errno) << std::endl;
+            return -1;
+        }
+        uint64_t size = (uint64_t)info.st_size;
+
+        // Só os cabeçalhos são lidos; o checksum é conferido no último bloco
+        // (o único que uma queda pode ter cortado) e nos blocos lidos por scan()
+        uint64_t offset = 0;
+        ColumnBlockHeader header;
+        while (offset + sizeof(header) <= size) {
+            if (pread(fd, &header, sizeof(header), (off_t)offset) != (ssize_t)sizeof(header) ||
+                header.magic != COLUMN_BLOCK_MAGIC || header.count == 0 || header.count > COLUMN_BLOCK_READINGS ||
+                offset + sizeof(header) + header.payloadBytes > size) {
+                break;
+            }
+            blocks.push_back({offset, header});
+            offset += sizeof(header) + header.payloadBytes;
+            if (header.flags & COLUMN_BLOCK_OPEN) {
+                break;
+            }
+        }
+        if (!blocks.empty() && !readPayload(blocks.back().header, blocks.back().offset)) {
+            offset = blocks.back().offset;
+            blocks.pop_back();
+        }
+        for (const ColumnBlockRef& block : blocks) {
+            newestTimestamp = hasReadings ? std::max(newestTimestamp, block.header.maxTimestamp)
+                                          : block.header.maxTimestamp;
+            hasReadings = true;
+        }
+        if (!writable) {
+            return 0;
+        }
+
+        if (offset < size) {
+            std::cerr << "Discarding " << (size - offset) << " torn bytes at the end of " << path << std::endl;
+            if (ftruncate(fd, (off_t)offset) != 0) {
+                std::cerr << "Error truncating column file " << path << ": " << std::strerror(errno) << std::endl;
+                return -1;
+            }
+        }
+        tailOffset = offset;
+        if (!blocks.empty() && (blocks.back().header.flags & COLUMN_BLOCK_OPEN)) {
+            ColumnBlockRef openBlock = blocks.back();
+            blocks.pop_back();
+            readPayload(openBlock.header, openBlock.offset);
+            decodeColumnBlock(openBlock.header, buffer.data(), [&](Timestamp timestamp, float value) {
+                tail.append(timestamp, value);
+            });
+            tailOffset = openBlock.offset;
+        }
+        return 0;
+    }
+
+    // 0 se a leitura entrou, COLUMN_REFUSED se não é mais nova que a última
+    // da série, -1 em erro de escrita
+    int append(Timestamp timestamp, float value) {
+        if (hasReadings && timestamp <= newestTimestamp) {
+            return COLUMN_REFUSED;
+        }
+        if (!tail.accepts(timestamp) && writeBlock(0) != 0) {
+            return -1;
+        }
+        tail.append(timestamp, value);
+        hasReadings = true;
+        newestTimestamp = timestamp;
+        dirty = true;
+        return 0;
+    }
+
+    bool newest(Timestamp& timestamp) const {
+        timestamp = newestTimestamp;
+        return hasReadings;
+    }
+
+    // Grava a cauda (aberta) no lugar da versão anterior
+    int sync() {
+        return dirty ? writeBlock(COLUMN_BLOCK_OPEN) : 0;
+    }
+
+    // Chama fn(timestamp, valor) para cada leitura em [from, to], pulando os
+    // blocos cuja faixa de tempo não cruza o intervalo
+    template <typename Fn>
+    int scan(Timestamp from, Timestamp to, Fn&& fn) {
+        auto inRange = [&](Timestamp timestamp, float value) {
+            if (timestamp >= from && timestamp <= to) {
+                fn(timestamp, value);
+            }
+        };
+        for (const ColumnBlockRef& block : blocks) {
+            if (block.header.maxTimestamp < from || block.header.minTimestamp > to) {
+                continue;
+            }
+            if (!readPayload(block.header, block.offset) ||
+                !decodeColumnBlock(block.header, buffer.data(), inRange)) {
+                std::cerr << "Corrupt column block at offset " << block.offset << " of " << path << std::endl;
+                return -1;
+            }
+        }
+        if (tail.count() > 0) {
+            ColumnBlockHeader header = tail.finish(COLUMN_BLOCK_OPEN);
+            if (header.maxTimestamp >= from && header.minTimestamp <= to) {
+                decodeColumnBlock(header, tail.payload().data(), inRange);
+            }
+        }
+        return 0;
+    }
+
+    void close() {
+        if (fd < 0) {
+            return;
+        }
+        if (writable) {
+            sync();
+            fsync(fd);
+        }
+        ::close(fd);
+        fd = -1;
+    }
+};
+
+// Diretório de séries, abertas sob demanda. Os sensores vêm de tópicos
+// quaisquer, então no máximo COLUMN_MAX_OPEN_SERIES ficam abertas: a usada
+// há mais tempo é gravada e fechada para abrir outra. Não é thread-safe: no
+// processador só a thread do BatchWriter o usa.
+class ColumnStore {
+private:
+    struct OpenSeries {
+        std::unique_ptr<ColumnSeries> series;
+        std::list<std::string>::iterator recent; // posição em recentlyUsed
+    };
+
+    std::string directory;
+    bool writable;
+    std::unordered_map<std::string, OpenSeries> series;
+    std::list<std::string> recentlyUsed; // da mais recente para a mais antiga
+    std::string key; // reaproveitada para não alocar a cada leitura
+
+    // Fecha a série usada há mais tempo cuja cauda pôde ser gravada
+    bool evict() {
+        for (auto it = recentlyUsed.end(); it != recentlyUsed.begin();) {
+            --it;
+            auto entry = series.find(*it);
+            if (entry->second.series->sync() == 0) {
+                series.erase(entry);
+                recentlyUsed.erase(it);
+                return true;
+            }
+        }
+        return false;
+    }
+
+    ColumnSeries* find(std::string_view machineId, std::string_view sensorId) {
+        key.assign(machineId);
+        key += '/';
+        key += sensorId;
+        auto it = series.find(key);
+        if (it != series.end()) {
+            recentlyUsed.splice(recentlyUsed.begin(), recentlyUsed, it->second.recent);
+            return it->second.series.get();
+        }
+        std::string path = directory + "/" + columnFileName(machineId, sensorId);
+        if (!writable && !std::filesystem::exists(path)) {
+            return nullptr;
+        }
+        if (series.size() >= COLUMN_MAX_OPEN_SERIES && !evict()) {
+            std::cerr << "Error opening column file " << path << ": no open series could be synced" << std::endl;
+            return nullptr;
+        }
+        auto opened = std::make_unique<ColumnSeries>();
+        if (opened->open(path, writable) != 0) {
+            return nullptr;
+        }
+        recentlyUsed.push_front(key);
+        return series.emplace(key, OpenSeries{std::move(opened), recentlyUsed.begin()}).first->second.series.get();
+    }
+
+public:
+    explicit ColumnStore(const std::string& storeDirectory, bool forWriting = true)
+        : directory(storeDirectory), writable(forWriting) {}
+
+    ~ColumnStore() {
+        close();
+    }
+
+    int open() {
+        std::error_code error;
+        if (writable && !std::filesystem::create_directories(directory, error) && error) {
+            std::cerr << "Error creating column store " << directory << ": " << error.message() << std::endl;
+            return -1;
+        }
+        return 0;
+    }
+
+    // Mesmo retorno de ColumnSeries::append
+    int append(std::string_view machineId, std::string_view sensorId, Timestamp timestamp, float value) {
+        ColumnSeries* target = find(machineId, sensorId);
+        return target ? target->append(timestamp, value) : -1;
+    }
+
+    // Timestamp mais novo da série; false se ela está vazia ou não abre
+    bool newest(std::string_view machineId, std::string_view sensorId, Timestamp& timestamp) {
+        ColumnSeries* target = find(machineId, sensorId);
+        return target && target->newest(timestamp);
+    }
+
+    // Uma cauda que não pôde ser gravada continua suja e volta no próximo sync()
+    int sync() {
+        int rc = 0;
+        for (auto& entry : series) {
+            if (entry.second.series->sync() != 0) {
+                rc = -1;
+            }
+        }
+        return rc;
+    }
+
+    template <typename Fn>
+    int scan(std::string_view machineId, std::string_view sensorId, Timestamp from, Timestamp to, Fn&& fn) {
+        ColumnSeries* target = find(machineId, sensorId);
+        return target ? target->scan(from, to, fn) : 0;
+    }
+
+    // Bytes ocupados pelos arquivos de série do diretório
+    uint64_t diskBytes() const {
+        uint64_t total = 0;
+        std::error_code error;
+        for (const auto& entry : std::filesystem::directory_iterator(directory, error)) {
+            if (entry.path().extension() == ".col") {
+                total += entry.file_size(error);
+            }
+        }
+        return total;
+    }
+
+    void close() {
+        series.clear();
+        recentlyUsed.clear();
+    }
+};
+
+// Fila circular limitada sem locks (algoritmo de Dmitry Vyukov). Cada
+// célula tem um número de sequência que diz se está livre para o produtor
+// ou pronta para o consumidor; produtores e consumidores só disputam os
+// índices com compare_exchange. A capacidade é arredondada para potência de 2.
+template <typename T>
+class BoundedQueue {
+private:
+    struct Cell {
+        std::atomic<size_t> sequence;
+        T data;
+    };
+
+    std::unique_ptr<Cell[]> cells;
+    size_t mask;
+    alignas(64) std::atomic<size_t> enqueuePos;
+    alignas(64) std::atomic<size_t> dequeuePos;
+
+public:
+    explicit BoundedQueue(size_t capacity) {
+        size_t size = 2;
+        while (size < capacity) {
+            size <<= 1;
+        }
+        cells.reset(new Cell[size]);
+        for (size_t i = 0; i < size; i++) {
+            cells[i].sequence.store(i, std::memory_order_relaxed);
+        }
+        mask = size - 1;
+        enqueuePos.store(0, std::memory_order_relaxed);
+        dequeuePos.store(0, std::memory_order_relaxed);
+    }
+
+    bool tryPush(T&& item) {
+        size_t pos = enqueuePos.load(std::memory_order_relaxed);
+        for (;;) {
+            Cell& cell = cells[pos & mask];
+            size_t seq = cell.sequence.load(std::memory_order_acquire);
+            intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+            if (diff == 0) {
+                if (enqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    cell.data = std::move(item);
+                    cell.sequence.store(pos + 1, std::memory_order_release);
+                    return true;
+                }
+            } else if (diff < 0) {
+                return false; // cheia
+            } else {
+                pos = enqueuePos.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    bool tryPop(T& item) {
+        size_t pos = dequeuePos.load(std::memory_order_relaxed);
+        for (;;) {
+            Cell& cell = cells[pos & mask];
+            size_t seq = cell.sequence.load(std::memory_order_acquire);
+            intptr_t diff = (intptr_t)seq - (intptr_t)(pos + 1);
+            if (diff == 0) {
+                if (dequeuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    item = std::move(cell.data);
+                    cell.sequence.store(pos + mask + 1, std::memory_order_release);
+                    return true;
+                }
+            } else if (diff < 0) {
+                return false; // vazia
+            } else {
+                pos = dequeuePos.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    // Aproximado: produtores e consumidores podem estar no meio de uma operação
+    size_t size() const {
+        size_t tail = enqueuePos.load(std::memory_order_relaxed);
+        size_t head = dequeuePos.load(std::memory_order_relaxed);
+        return tail > head ? tail - head : 0;
+    }
+
+    size_t capacity() const {
+        return mask + 1;
+    }
+};
+
+// O que fazer quando a fila entre o MQTT e o SQLite está cheia
+enum class BackpressurePolicy {
+    BLOCK,        // o produtor espera abrir espaço
+    DROP_OLDEST,  // descarta a linha mais antiga da fila
+    SPILL         // grava a linha em um arquivo e reenvia depois
+};
+
+bool parseBackpressurePolicy(const std::string& name, BackpressurePolicy& policy) {
+    if (name == "block") {
+        policy = BackpressurePolicy::BLOCK;
+    } else if (name == "drop-oldest") {
+        policy = BackpressurePolicy::DROP_OLDEST;
+    } else if (name == "spill") {
+        policy = BackpressurePolicy::SPILL;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+// Linha pendente de gravação: leitura de sensor ou alarme
+struct StorageRow {
+    bool isAlarm = false;
+    std::string machineId;
+    std::string id; // sensor_id ou alarm_type
+    float value = 0.0f;
+    Timestamp timestamp = 0;
+};
+
+// Contadores exportados pelo escritor
+struct StorageStats {
+    size_t queueDepth;
+    size_t queueCapacity;
+    uint64_t enqueued;
+    uint64_t dropped;
+    uint64_t spilled;
+    uint64_t committed;
+    uint64_t columnPending; // já no SQLite, aguardando o armazenamento colunar
+};
+
+// Escritor em lote: as threads de ingestão (callback do MQTT) só colocam
+// linhas na BoundedQueue; uma thread dedicada esvazia a fila e grava tudo
+// em uma única transação (BEGIN...COMMIT) quando o lote enche ou quando a
+// linha mais antiga do lote atinge BATCH_MAX_LATENCY_MS. Só o que já foi
+// confirmado pelo COMMIT é durável; no pior caso uma queda perde a fila e
+// o último lote.
+class BatchWriter {
+private:
+    size_t maxBatch;
+    std::chrono::milliseconds maxLatency;
+    BackpressurePolicy policy;
+    BoundedQueue<StorageRow> queue;
+    std::atomic<bool> running;
+    std::atomic<uint64_t> enqueuedRows;
+    std::atomic<uint64_t> droppedRows;
+    std::atomic<uint64_t> spilledRows;
+    std::atomic<uint64_t> committedRows;
+    std::atomic<uint64_t> pendingSpill;
+    std::string spillPath;
+    std::string replayPath; // transbordo sendo reenviado; só some após o COMMIT
+    std::ofstream spillOut; // aberto enquanto houver transbordo, protegido por spillMutex
+    std::mutex spillMutex;
+    std::chrono::steady_clock::time_point nextReplay;
+    ColumnStore* columnStore; // leituras também (ou só) no armazenamento colunar
+    std::vector<StorageRow> columnPending; // leituras que o armazenamento colunar recusou
+    std::atomic<uint64_t> columnPendingRows;
+    std::chrono::steady_clock::time_point nextColumnRetry;
+    bool sqliteReadings;
+    // Só colunar: timestamp mais novo aceito por série ("<machine>/<sensor>"),
+    // incluindo as leituras que ainda estão em columnPending
+    std::unordered_map<std::string, Timestamp> columnNewest;
+    std::unordered_map<std::string, Timestamp> batchNewest; // aceitos no lote corrente
+    std::string columnKey;
+    RollupAccumulator rollups;
+    std::thread flusher;
+
+    void enqueue(StorageRow&& row) {
+        enqueuedRows++;
+        int attempts = 0;
+        while (!queue.tryPush(std::move(row))) {
+            if (policy == BackpressurePolicy::DROP_OLDEST) {
+                StorageRow oldest;
+                if (queue.tryPop(oldest)) {
+                    droppedRows++;
+                }
+            } else if (policy == BackpressurePolicy::SPILL) {
+                spill(row);
+                return;
+            } else if (++attempts < 64) {
+                std::this_thread::yield();
+            } else {
+                std::this_thread::sleep_for(std::chrono::microseconds(100));
+            }
+        }
+    }
+
+    // Formato do arquivo de transbordo: uma linha por registro, campos
+    // separados por tab (os ids e timestamps nunca contêm tab/newline). O
+    // arquivo fica aberto enquanto a fila estiver transbordando.
+    void spill(const StorageRow& row) {
+        std::lock_guard<std::mutex> lock(spillMutex);
+        if (!spillOut.is_open()) {
+            spillOut.clear();
+            spillOut.open(spillPath, std::ios::app);
+            spillOut << std::setprecision(9);
+        }
+        if (!spillOut) {
+            std::cerr << "Error opening spill file " << spillPath << std::endl;
+            spillOut.close();
+            droppedRows++;
+            return;
+        }
+        spillOut << (row.isAlarm ? 'A' : 'S') << '\t' << row.machineId << '\t' << row.id << '\t'
+                 << row.value << '\t' << row.timestamp << '\n';
+        spilledRows++;
+        pendingSpill++;
+    }
+
+    // Move o arquivo de transbordo para replayPath e lê suas linhas. O arquivo
+    // de replay só é apagado por finishReplay, depois que todas as linhas
+    // foram gravadas ou transbordadas de novo; se o processo cair no meio, a
+    // próxima execução reenvia o replay inteiro: leituras repetidas são
+    // ignoradas pela chave de readings, mas os alarmes dos lotes já
+    // confirmados são gravados de novo.
+    std::vector<StorageRow> takeSpilled() {
+        std::vector<StorageRow> rows;
+        std::lock_guard<std::mutex> lock(spillMutex);
+        spillOut.close();
+        // Um replay interrompido é reenviado antes de um transbordo novo
+        if (!std::ifstream(replayPath)) {
+            if (std::rename(spillPath.c_str(), replayPath.c_str()) != 0) {
+                pendingSpill = 0;
+                return rows;
+            }
+            pendingSpill = 0;
+        }
+        std::ifstream in(replayPath);
+        std::string line;
+        while (std::getline(in, line)) {
+            std::istringstream fields(line);
+            std::string kind, value, timestamp;
+            StorageRow row;
+            std::getline(fields, kind, '\t');
+            std::getline(fields, row.machineId, '\t');
+            std::getline(fields, row.id, '\t');
+            std::getline(fields, value, '\t');
+            std::getline(fields, timestamp, '\t');
+            row.isAlarm = kind == "A";
+            row.value = std::strtof(value.c_str(), nullptr);
+            row.timestamp = std::strtoll(timestamp.c_str(), nullptr, 10);
+            rows.push_back(std::move(row));
+        }
+        return rows;
+    }
+
+    // Apaga o replay; as linhas que falharam já voltaram para o transbordo
+    void finishReplay(size_t failedRows) {
+        std::lock_guard<std::mutex> lock(spillMutex);
+        spillOut.flush();
+        std::remove(replayPath.c_str());
+        if (failedRows > 0) {
+            std::cerr << "Replay of spilled rows failed; " << failedRows
+                      << " rows spilled again" << std::endl;
+            nextReplay = std::chrono::steady_clock::now() + std::chrono::milliseconds(SPILL_RETRY_MS);
+        }
+    }
+
+    // Só colunar: a leitura entra se for mais nova que a última aceita da
+    // série, no lote corrente ou antes dele (a regra do ColumnSeries::append).
+    // Uma série vazia começa pela primeira leitura; uma que não abre também,
+    // e a leitura fica em columnPending.
+    bool columnAccepts(const StorageRow& row) {
+        columnKey.assign(row.machineId).append("/").append(row.id);
+        auto it = batchNewest.find(columnKey);
+        if (it == batchNewest.end()) {
+            auto known = columnNewest.find(columnKey);
+            Timestamp newest;
+            if (known != columnNewest.end()) {
+                newest = known->second;
+            } else if (!columnStore->newest(row.machineId, row.id, newest)) {
+                batchNewest.emplace(columnKey, row.timestamp);
+                return true;
+            }
+            it = batchNewest.emplace(columnKey, newest).first;
+        }
+        if (row.timestamp <= it->second) {
+            return false;
+        }
+        it->second = row.timestamp;
+        return true;
+    }
+
+    // Desfaz o lote; ids de dimensão criados nele deixam de existir
+    void rollback() {
+        execSQL("ROLLBACK;");
+        dimensionIds.clear();
+        rollups.clear();
+        batchNewest.clear();
+    }
+
+    // Acrescenta as leituras ao armazenamento colunar. Uma leitura que não
+    // entrou (arquivo que não abre, bloco cheio que não foi gravado) fica em
+    // columnPending e é tentada de novo; uma repetida ou fora de ordem
+    // (COLUMN_REFUSED) é descartada; uma cauda que entrou mas não foi
+    // gravada continua suja e vai no próximo sync(). Acima de
+    // STORAGE_QUEUE_CAPACITY pendentes as mais antigas são descartadas.
+    void appendColumns(const std::vector<StorageRow>& rows) {
+        std::vector<StorageRow> retry;
+        retry.swap(columnPending);
+        auto append = [&](const StorageRow& row) {
+            if (!row.isAlarm && columnStore->append(row.machineId, row.id, row.timestamp, row.value) < 0) {
+                columnPending.push_back(row);
+            }
+        };
+        std::for_each(retry.begin(), retry.end(), append);
+        std::for_each(rows.begin(), rows.end(), append);
+        if (columnStore->sync() != 0) {
+            std::cerr << "Error syncing column store; retrying on the next batch" << std::endl;
+        }
+        if (columnPending.size() > STORAGE_QUEUE_CAPACITY) {
+            size_t excess = columnPending.size() - STORAGE_QUEUE_CAPACITY;
+            columnPending.erase(columnPending.begin(), columnPending.begin() + excess);
+            droppedRows += excess;
+        }
+        if (!columnPending.empty()) {
+            std::cerr << columnPending.size() << " readings pending for the column store" << std::endl;
+            nextColumnRetry = std::chrono::steady_clock::now() + std::chrono::milliseconds(COLUMN_RETRY_MS);
+        }
+        columnPendingRows = columnPending.size();
+    }
+
+    // Grava um lote inteiro em uma transação, com os rollups das leituras;
+    // em caso de erro desfaz tudo. As leituras só vão para o armazenamento
+    // colunar depois do COMMIT, para que um lote desfeito não apareça lá;
+    // falhas do lado colunar não desfazem o COMMIT e são tratadas por
+    // appendColumns. Com partições, as janelas do lote são anexadas antes do
+    // BEGIN (ATTACH não roda dentro de transação).
+    int commitBatch(const std::vector<StorageRow>& rows) {
+        if (partitions.enabled() && sqliteReadings) {
+            std::vector<Timestamp> windows;
+            for (const StorageRow& row : rows) {
+                if (row.isAlarm || partitions.expired(row.timestamp)) {
+                    continue;
+                }
+                Timestamp start = partitions.windowStart(row.timestamp);
+                if (std::find(windows.begin(), windows.end(), start) == windows.end()) {
+                    windows.push_back(start);
+                }
+            }
+            // Lote espalhado por janelas demais (p.ex. um transbordo antigo):
+            // grava em duas metades
+            if (windows.size() > PARTITION_MAX_ATTACHED) {
+                std::vector<StorageRow> first(rows.begin(), rows.begin() + rows.size() / 2);
+                std::vector<StorageRow> second(rows.begin() + rows.size() / 2, rows.end());
+                int firstRc = commitBatch(first);
+                int secondRc = commitBatch(second);
+                return firstRc == 0 && secondRc == 0 ? 0 : -1;
+            }
+            if (partitions.prepare(windows) != 0) {
+                return -1;
+            }
+        }
+        if (execSQL("BEGIN;") != 0) {
+            return -1;
+        }
+        for (const StorageRow& row : rows) {
+            int rc = 0;
+            if (row.isAlarm) {
+                rc = insertAlarm(row.machineId, row.id, row.timestamp);
+            } else {
+                // Leitura de uma janela que a retenção já apagou: não vai
+                // para readings, mas ainda entra nos rollups
+                bool duplicate = false;
+                if (sqliteReadings && !partitions.expired(row.timestamp)) {
+                    rc = insertSensorData(row.machineId, row.id, row.value, row.timestamp);
+                    duplicate = rc == 0 && sqlite3_changes(db) == 0;
+                } else if (!sqliteReadings) {
+                    duplicate = !columnAccepts(row);
+                }
+                if (rc == 0 && !duplicate) {
+                    rc = rollups.add(row.machineId, row.id, row.timestamp, row.value);
+                }
+            }
+            if (rc != 0) {
+                rollback();
+                return -1;
+            }
+        }
+        if (rollups.flush() != 0 || execSQL("COMMIT;") != 0) {
+            rollback();
+            return -1;
+        }
+        for (const auto& accepted : batchNewest) {
+            columnNewest[accepted.first] = accepted.second;
+        }
+        batchNewest.clear();
+        if (columnStore) {
+            appendColumns(rows);
+        }
+        committedRows += rows.size();
+        return 0;
+    }
+
+    // Um lote que não foi gravado conta como descartado
+    void commitAndClear(std::vector<StorageRow>& rows) {
+        if (commitBatch(rows) != 0) {
+            std::cerr << "Error committing batch of " << rows.size() << " rows" << std::endl;
+            droppedRows += rows.size();
+        }
+        rows.clear();
+    }
+
+    void run() {
+        std::vector<StorageRow> batch;
+        batch.reserve(maxBatch);
+        std::chrono::steady_clock::time_point oldest;
+        StorageRow row;
+
+        for (;;) {
+            bool stopping = !running.load();
+            // Partições que a retenção expirou saem antes do próximo lote
+            partitions.dropRetired();
+            while (batch.size() < maxBatch && queue.tryPop(row)) {
+                if (batch.empty()) {
+                    oldest = std::chrono::steady_clock::now();
+                }
+                batch.push_back(std::move(row));
+            }
+
+            if (!batch.empty() && (batch.size() >= maxBatch || stopping ||
+                                   std::chrono::steady_clock::now() >= oldest + maxLatency)) {
+                commitAndClear(batch);
+                continue;
+            }
+
+            // Linhas transbordadas só voltam quando a fila em memória
+            // esvaziou; um lote que falha é transbordado de novo e o replay
+            // espera SPILL_RETRY_MS antes da próxima tentativa
+            if (batch.empty() && pendingSpill > 0 && std::chrono::steady_clock::now() >= nextReplay) {
+                std::vector<StorageRow> spilled = takeSpilled();
+                size_t failed = 0;
+                for (size_t i = 0; i < spilled.size(); i += maxBatch) {
+                    size_t end = std::min(spilled.size(), i + maxBatch);
+                    batch.assign(std::make_move_iterator(spilled.begin() + i),
+                                 std::make_move_iterator(spilled.begin() + end));
+                    if (commitBatch(batch) != 0) {
+                        for (const StorageRow& failedRow : batch) {
+                            spill(failedRow);
+                        }
+                        failed += batch.size();
+                    }
+                    batch.clear();
+                }
+                finishReplay(failed);
+                continue;
+            }
+
+            // Leituras recusadas pelo armazenamento colunar também voltam
+            // sem esperar um lote novo
+            if (batch.empty() && !columnPending.empty() &&
+                (stopping || std::chrono::steady_clock::now() >= nextColumnRetry)) {
+                appendColumns({});
+                if (stopping && !columnPending.empty()) {
+                    std::cerr << "Discarding " << columnPending.size()
+                              << " readings that never reached the column store" << std::endl;
+                    droppedRows += columnPending.size();
+                    columnPending.clear();
+                    columnPendingRows = 0;
+                }
+            }
+
+            if (stopping && batch.empty() && queue.size() == 0) {
+                break;
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(WRITER_POLL_MS));
+        }
+    }
+
+public:
+    BatchWriter(size_t batchSize, std::chrono::milliseconds latency,
+                BackpressurePolicy backpressure = BackpressurePolicy::BLOCK,
+                size_t queueCapacity = STORAGE_QUEUE_CAPACITY,
+                const std::string& spillFile = "sensor_data.spill",
+                ColumnStore* columns = nullptr, bool readingsInSqlite = true)
+        : maxBatch(batchSize), maxLatency(latency), policy(backpressure), queue(queueCapacity),
+          running(true), enqueuedRows(0), droppedRows(0), spilledRows(0), committedRows(0),
+          pendingSpill(0), spillPath(spillFile), replayPath(spillFile + ".replay"),
+          columnStore(columns), columnPendingRows(0), sqliteReadings(readingsInSqlite) {
+        // Recupera linhas transbordadas (ou um replay interrompido) por uma
+        // execução anterior
+        if (std::ifstream(spillPath) || std::ifstream(replayPath)) {
+            pendingSpill = 1;
+        }
+        flusher = std::thread(&BatchWriter::run, this);
+    }
+
+    ~BatchWriter() {
+        stop();
+    }
+
+    void addSensorData(std::string_view machineId, std::string_view sensorId, float value, Timestamp timestamp) {
+        StorageRow row;
+        row.machineId = machineId;
+        row.id = sensorId;
+        row.value = value;
+        row.timestamp = timestamp;
+        enqueue(std::move(row));
+    }
+
+    void addAlarm(std::string_view machineId, std::string_view alarmType, Timestamp timestamp) {
+        if(alarmType !="inactive"){ 
+            std::cout << "ALARM: " << machineId << ".alarms." << alarmType << "  TIME: " + formatTimestamp(timestamp) << std::endl;
+        }
+        StorageRow row;
+        row.isAlarm = true;
+        row.machineId = machineId;
+        row.id = alarmType;
+        row.timestamp = timestamp;
+        enqueue(std::move(row));
+    }
+
+    StorageStats stats() const {
+        return {queue.size(), queue.capacity(), enqueuedRows.load(), droppedRows.load(),
+                spilledRows.load(), committedRows.load(), columnPendingRows.load()};
+    }
+
+    // Grava o que estiver pendente e encerra a thread de escrita
+    void stop() {
+        running = false;
+        if (flusher.joinable()) {
+            flusher.join();
+        }
+    }
+};
+
+// Handle inteiro compacto de um sensor já visto pelo processador
+using SensorHandle = uint32_t;
+
+// Tabela de chaves de sensor ("<machine_id>/<sensor_id>") -> handles densos
+// (0, 1, 2, ...), que nunca são reaproveitados. A busca de um nome já conhecido só pega o lock
+// compartilhado; o lock exclusivo fica para a primeira vez de cada nome.
+class SensorInterner {
+private:
+    std::deque<std::string> names; // deque mantém os endereços estáveis
+    std::unordered_map<std::string_view, SensorHandle> handles;
+    mutable std::shared_mutex mutex;
+
+public:
+    SensorHandle intern(std::string_view name) {
+        {
+            std::shared_lock<std::shared_mutex> lock(mutex);
+            auto it = handles.find(name);
+            if (it != handles.end()) {
+                return it->second;
+            }
+        }
+        std::unique_lock<std::shared_mutex> lock(mutex);
+        auto it = handles.find(name);
+        if (it != handles.end()) {
+            return it->second;
+        }
+        SensorHandle handle = (SensorHandle)names.size();
+        names.emplace_back(name);
+        handles.emplace(names.back(), handle);
+        return handle;
+    }
+
+    const std::string& name(SensorHandle handle) const {
+        std::shared_lock<std::shared_mutex> lock(mutex);
+        return names[handle];
+    }
+};
+
+// Estado dos sensores dividido em SENSOR_SHARDS partes, cada uma com seu
+// próprio mutex. Como os handles são densos, o shard é handle % SENSOR_SHARDS
+// e a posição dentro dele é handle / SENSOR_SHARDS: um vetor contíguo por
+// shard, sem árvore nem hash. Mensagens de sensores em shards diferentes não
+// disputam lock, e a varredura de inatividade trava um shard por vez.
+class SensorStateTable {
+private:
+    struct Slot {
+        SensorData data;
+        bool present = false;
+    };
+
+    struct alignas(64) Shard {
+        std::mutex mutex;
+        std::vector<Slot> slots;
+    };
+
+    std::array<Shard, SENSOR_SHARDS> shards;
+
+public:
+    // Atualiza o estado; retorna false se for a primeira leitura de um
+    // sensor que não foi anunciado em /sensor_monitors
+    bool update(SensorHandle handle, float value, Timestamp timestamp, int64_t arrival) {
+        Shard& shard = shards[handle % SENSOR_SHARDS];
+        size_t index = handle / SENSOR_SHARDS;
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        if (index >= shard.slots.size()) {
+            shard.slots.resize(index + 1);
+        }
+
+        Slot& slot = shard.slots[index];
+        if (!slot.present) {
+            slot.present = true;
+            slot.data = {value, timestamp};
+            slot.data.lastArrival = arrival;
+            return false;
+        }
+        slot.data.value = value;
+        slot.data.timestamp = timestamp;
+        slot.data.missed_periods = 0;  // Reset missed periods ao receber novo dado
+        slot.data.lastArrival = arrival;
+        slot.data.hasReading = true;
+        return true;
+    }
+
+    // Pré-aloca o estado de um sensor anunciado e registra seu período.
+    // Um sensor já existente mantém a última leitura e só troca o período.
+    void announce(SensorHandle handle, int64_t intervalNs, Timestamp now, int64_t arrival) {
+        Shard& shard = shards[handle % SENSOR_SHARDS];
+        size_t index = handle / SENSOR_SHARDS;
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        if (index >= shard.slots.size()) {
+            shard.slots.resize(index + 1);
+        }
+
+        Slot& slot = shard.slots[index];
+        if (!slot.present) {
+            slot.present = true;
+            slot.data = {0.0f, now};
+            slot.data.lastArrival = arrival;
+            slot.data.hasReading = false;
+        }
+        slot.data.intervalNs = intervalNs;
+    }
+
+    // Executa visit sobre o estado de um sensor com o shard travado
+    template <typename Visitor>
+    void visit(SensorHandle handle, Visitor&& visit) {
+        Shard& shard = shards[handle % SENSOR_SHARDS];
+        size_t index = handle / SENSOR_SHARDS;
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        if (index < shard.slots.size() && shard.slots[index].present) {
+            visit(shard.slots[index].data);
+        }
+    }
+};
+
+// Roda de temporização hierárquica (3 níveis de WHEEL_SLOTS posições) para
+// os prazos de inatividade. O nível 0 tem resolução de um tick; cada nível
+// acima cobre WHEEL_SLOTS vezes mais tempo e é redistribuído para o nível de
+// baixo quando o tick atual entra na sua faixa. Agendar é O(1) e avançar
+// custa proporcional aos ticks e aos timers que vencem, não ao número de
+// sensores. Prazos além do último nível ficam no último nível e são
+// reagendados quando chegam lá.
+class TimerWheel {
+public:
+    struct Timer {
+        SensorHandle handle;
+        int64_t deadline; // steadyNanos()
+    };
+
+private:
+    static const int LEVELS = 3;
+    static const int SLOT_BITS = 8;
+    static const int64_t SLOTS = 1 << SLOT_BITS;
+    static const int64_t SLOT_MASK = SLOTS - 1;
+
+    int64_t tickNs;
+    int64_t currentTick;
+    std::array<std::array<std::vector<Timer>, SLOTS>, LEVELS> levels;
+    std::vector<Timer> cascading;
+    std::vector<Timer> due; // prazos já vencidos ao agendar
+    std::mutex mutex;
+
+    void insert(const Timer& timer) {
+        int64_t tick = (timer.deadline + tickNs - 1) / tickNs;
+        int64_t delta = tick - currentTick;
+        if (delta <= 0) {
+            // Já venceu: sai no próximo advance, sem esperar mais um tick
+            due.push_back(timer);
+            return;
+        }
+        for (int level = 0; level < LEVELS; level++) {
+            if (delta < ((int64_t)1 << (SLOT_BITS * (level + 1)))) {
+                levels[level][(tick >> (SLOT_BITS * level)) & SLOT_MASK].push_back(timer);
+                return;
+            }
+        }
+        int64_t last = currentTick + ((int64_t)1 << (SLOT_BITS * LEVELS)) - 1;
+        levels[LEVELS - 1][(last >> (SLOT_BITS * (LEVELS - 1))) & SLOT_MASK].push_back(timer);
+    }
+
+    // Move os timers de um slot de nível superior para os níveis de baixo
+    void cascade(int level) {
+        std::vector<Timer>& slot = levels[level][(currentTick >> (SLOT_BITS * level)) & SLOT_MASK];
+        cascading.swap(slot);
+        for (const Timer& timer : cascading) {
+            insert(timer);
+        }
+        cascading.clear();
+    }
+
+public:
+    TimerWheel(int64_t tick, int64_t now) : tickNs(tick), currentTick(now / tick) {}
+
+    void schedule(SensorHandle handle, int64_t deadline) {
+        std::lock_guard<std::mutex> lock(mutex);
+        insert({handle, deadline});
+    }
+
+    // Avança até now e acrescenta em expired os timers vencidos
+    void advance(int64_t now, std::vector<Timer>& expired) {
+        std::lock_guard<std::mutex> lock(mutex);
+        int64_t target = now / tickNs;
+        while (currentTick < target) {
+            currentTick++;
+            for (int level = LEVELS - 1; level > 0; level--) {
+                if ((currentTick & (((int64_t)1 << (SLOT_BITS * level)) - 1)) == 0) {
+                    cascade(level);
+                }
+            }
+            std::vector<Timer>& slot = levels[0][currentTick & SLOT_MASK];
+            expired.insert(expired.end(), slot.begin(), slot.end());
+            slot.clear();
+        }
+        expired.insert(expired.end(), due.begin(), due.end());
+        due.clear();
+    }
+};
+
+// Codificação binária (CBOR, RFC 8949) negociada no anúncio com
+// "encoding": "cbor". Leitura: mapa {0: timestamp em ns, 1: valor float}.
+// Anúncio: o mesmo mapa do JSON, com chaves texto. O primeiro byte de uma
+// mensagem CBOR é um mapa (0xa0-0xbf), que nunca inicia um JSON válido.
+const uint8_t CBOR_READING_KEY_TIMESTAMP = 0;
+const uint8_t CBOR_READING_KEY_VALUE = 1;
+
+bool isCborMessage(std::string_view message) {
+    return !message.empty() && ((uint8_t)message[0] & 0xe0) == 0xa0;
+}
+
+enum class WireEncoding {
+    JSON,
+    CBOR
+};
+
+// Codificação anunciada por cada máquina; as leituras de quem não se
+// anunciou são JSON. Mesmo esquema do SensorInterner: a busca de uma
+// máquina conhecida só pega o lock compartilhado e não aloca.
+class MachineEncodings {
+private:
+    std::deque<std::string> names; // deque mantém os endereços estáveis
+    std::unordered_map<std::string_view, WireEncoding> encodings;
+    mutable std::shared_mutex mutex;
+
+public:
+    void set(std::string_view machineId, WireEncoding encoding) {
+        std::unique_lock<std::shared_mutex> lock(mutex);
+        auto it = encodings.find(machineId);
+        if (it != encodings.end()) {
+            it->second = encoding;
+            return;
+        }
+        names.emplace_back(machineId);
+        encodings.emplace(names.back(), encoding);
+    }
+
+    WireEncoding get(std::string_view machineId) const {
+        std::shared_lock<std::shared_mutex> lock(mutex);
+        auto it = encodings.find(machineId);
+        return it != encodings.end() ? it->second : WireEncoding::JSON;
+    }
+};
+
+// Cursor sobre uma leitura CBOR; só lê, não aloca. Itens de tamanho
+// indefinido não são aceitos. Anúncios, que são raros, usam o
+// json::from_cbor.
+class CborReader {
+private:
+    const uint8_t* pos;
+    const uint8_t* end;
+
+    bool header(uint8_t& major, uint64_t& argument) {
+        if (pos >= end) {
+            return false;
+        }
+        major = *pos >> 5;
+        uint8_t info = *pos & 0x1f;
+        pos++;
+        if (info < 24) {
+            argument = info;
+            return true;
+        }
+        if (info > 27) {
+            return false;
+        }
+        size_t bytes = (size_t)1 << (info - 24);
+        if ((size_t)(end - pos) < bytes) {
+            return false;
+        }
+        argument = 0;
+        for (size_t i = 0; i < bytes; i++) {
+            argument = (argument << 8) | *pos++;
+        }
+        return true;
+    }
+
+public:
+    explicit CborReader(std::string_view data)
+        : pos((const uint8_t*)data.data()), end((const uint8_t*)data.data() + data.size()) {}
+
+    bool atEnd() const {
+        return pos == end;
+    }
+
+    bool readMap(uint64_t& entries) {
+        uint8_t major;
+        return header(major, entries) && major == 5;
+    }
+
+    bool readInt(int64_t& out) {
+        uint8_t major;
+        uint64_t argument;
+        if (!header(major, argument) || argument > (uint64_t)INT64_MAX) {
+            return false;
+        }
+        if (major == 0) {
+            out = (int64_t)argument;
+        } else if (major == 1) {
+            out = -1 - (int64_t)argument;
+        } else {
+            return false;
+        }
+        return true;
+    }
+
+    // Aceita float de 32 e 64 bits e inteiros
+    bool readNumber(double& out) {
+        if (pos >= end) {
+            return false;
+        }
+        if (*pos == 0xfa || *pos == 0xfb) {
+            uint8_t major;
+            uint64_t bits;
+            bool single = *pos == 0xfa;
+            if (!header(major, bits)) {
+                return false;
+            }
+            if (single) {
+                uint32_t narrow = (uint32_t)bits;
+                float f;
+                std::memcpy(&f, &narrow, sizeof(f));
+                out = f;
+            } else {
+                std::memcpy(&out, &bits, sizeof(out));
+            }
+            return true;
+        }
+        int64_t integer;
+        if (!readInt(integer)) {
+            return false;
+        }
+        out = (double)integer;
+        return true;
+    }
+
+};
+
+// Leitura em CBOR: {0: timestamp, 1: valor}, em qualquer ordem
+bool parseSensorPayloadCBOR(std::string_view payload, float& value, Timestamp& timestamp) {
+    CborReader reader(payload);
+    uint64_t entries;
+    if (!reader.readMap(entries) || entries != 2) {
+        return false;
+    }
+    bool hasValue = false;
+    bool hasTimestamp = false;
+    for (uint64_t i = 0; i < entries; i++) {
+        int64_t key;
+        if (!reader.readInt(key)) {
+            return false;
+        }
+        if (key == CBOR_READING_KEY_TIMESTAMP) {
+            if (!reader.readInt(timestamp)) {
+                return false;
+            }
+            hasTimestamp = true;
+        } else if (key == CBOR_READING_KEY_VALUE) {
+            double number;
+            if (!reader.readNumber(number)) {
+                return false;
+            }
+            value = (float)number;
+            hasValue = true;
+        } else {
+            return false;
+        }
+    }
+    return hasValue && hasTimestamp && reader.atEnd();
+}
+
+// Conteúdo de um anúncio em /sensor_monitors, em JSON ou CBOR
+struct SensorAnnouncement {
+    std::string sensorId;
+    std::string dataType;
+    int dataInterval = 0;
+};
+
+struct MachineAnnouncement {
+    std::string machineId;
+    std::string encoding = "json";
+    std::vector<SensorAnnouncement> sensors;
+};
+
+// Anúncios em JSON ou CBOR viram o mesmo json e são lidos do mesmo jeito
+bool parseAnnouncement(std::string_view message, MachineAnnouncement& out) {
+    json root = isCborMessage(message)
+        ? json::from_cbor(message.begin(), message.end(), true, false)
+        : json::parse(message.begin(), message.end(), nullptr, false);
+    if (root.is_discarded() || !root.is_object()) {
+        return false;
+    }
+    const json::const_iterator machineId = root.find("machine_id");
+    const json::const_iterator encoding = root.find("encoding");
+    const json::const_iterator sensors = root.find("sensors");
+    if (machineId == root.end() || !machineId->is_string() || sensors == root.end() || !sensors->is_array()) {
+        return false;
+    }
+    out.machineId = machineId->get<std::string>();
+    if (encoding != root.end()) {
+        out.encoding = encoding->is_string() ? encoding->get<std::string>() : "";
+    }
+    // Campos ausentes ou do tipo errado ficam vazios/zero, e o sensor é
+    // recusado como inválido (json::value() lançaria type_error)
+    for (const json& sensor : *sensors) {
+        SensorAnnouncement item;
+        if (sensor.is_object()) {
+            const json::const_iterator sensorId = sensor.find("sensor_id");
+            const json::const_iterator dataType = sensor.find("data_type");
+            const json::const_iterator dataInterval = sensor.find("data_interval");
+            if (sensorId != sensor.end() && sensorId->is_string()) {
+                item.sensorId = sensorId->get<std::string>();
+            }
+            if (dataType != sensor.end() && dataType->is_string()) {
+                item.dataType = dataType->get<std::string>();
+            }
+            if (dataInterval != sensor.end() && dataInterval->is_number_integer()) {
+                int64_t interval = dataInterval->get<int64_t>();
+                if (interval > 0 && interval <= std::numeric_limits<int>::max()) {
+                    item.dataInterval = (int)interval;
+                }
+            }
+        }
+        out.sensors.push_back(item);
+    }
+    return true;
+}
+
+// Tópico de leitura já separado em partes; todas apontam para o tópico
+// original. key é "<machine_id>/<sensor_id>", usada para o SensorInterner.
+struct SensorTopic {
+    std::string_view key;
+    std::string_view machineId;
+    std::string_view sensorId;
+};
+
+// Separa "/sensors/<machine_id>/<sensor_id>" em uma passada, sem alocar
+bool parseSensorTopic(std::string_view topic, SensorTopic& out) {
+    const std::string_view prefix = "/sensors/";
+    if (topic.substr(0, prefix.size()) != prefix) {
+        return false;
+    }
+    std::string_view key = topic.substr(prefix.size());
+    size_t slash = key.find('/');
+    if (slash == std::string_view::npos || slash == 0 || slash + 1 == key.size() ||
+        key.find('/', slash + 1) != std::string_view::npos) {
+        return false;
+    }
+    out.key = key;
+    out.machineId = key.substr(0, slash);
+    out.sensorId = key.substr(slash + 1);
+    return true;
+}
+
+// Processamento de dados dos sensores
+class DataProcessor {
+private:
+    mqtt::async_client& client;
+    BatchWriter& writer;
+    SensorInterner sensorKeys;
+    SensorStateTable sensorStates;
+    MachineEncodings machineEncodings;
+    TimerWheel inactivityTimers;
+    std::vector<TimerWheel::Timer> expiredTimers;
+
+    // (Re)arma o prazo de inatividade: 3 períodos após a última chegada.
+    // Timers antigos do mesmo sensor ficam obsoletos pelo armedDeadline.
+    void armInactivityTimer(SensorHandle handle) {
+        int64_t deadline = 0;
+        sensorStates.visit(handle, [&](SensorData& data) {
+            deadline = data.lastArrival + 3 * data.intervalNs;
+            data.armedDeadline = deadline;
+        });
+        inactivityTimers.schedule(handle, deadline);
+    }
+
+public:
+    DataProcessor(mqtt::async_client& mqttClient, BatchWriter& batchWriter)
+        : client(mqttClient), writer(batchWriter),
+          inactivityTimers(TIMER_TICK_MS * 1000000LL, steadyNanos()) {}
+
+    // Função para processar os dados de temperatura e umidade
+    void processSensorData(const SensorTopic& topic, float value, Timestamp timestamp) {
+        // Atualiza os dados do sensor; na primeira leitura só cria o estado.
+        // Chegadas seguintes não mexem na TimerWheel: o prazo é conferido
+        // contra lastArrival quando o timer vence.
+        SensorHandle handle = sensorKeys.intern(topic.key);
+        if (!sensorStates.update(handle, value, timestamp, steadyNanos())) {
+            armInactivityTimer(handle);
+            return;
+        }
+
+        // Enfileira fora do lock do shard: com backpressure BLOCK a fila
+        // cheia segura só esta thread, não o checkInactiveSensors
+        const std::string_view machineId = topic.machineId;
+        const std::string_view sensorId = topic.sensorId;
+        writer.addSensorData(machineId, sensorId, value, timestamp);
+ 
+        if (sensorId == SENSOR_ID_TEMPERATURE) {
+            if (value > 20.0f && value < 26.0f) {
+                writer.addAlarm(machineId, "good_temperature", timestamp);
+            }
+            if (value < 20.0f) {
+                writer.addAlarm(machineId, "low_temperature", timestamp);
+            }
+            if (value > 26.0f) {
+                writer.addAlarm(machineId, "high_temperature", timestamp);
+            }
+        } else if (sensorId == SENSOR_ID_HUMIDITY) {
+            if (value > 40.0f && value < 60.0f) {
+                writer.addAlarm(machineId, "good_humidity", timestamp);
+            }
+            if (value < 40.0f) {
+                writer.addAlarm(machineId, "low_humidity", timestamp);
+            }
+            if (value > 60.0f) {
+                writer.addAlarm(machineId, "high_humidity", timestamp);
+            }
+        }
+        
+    }
+
+    // Codificação das leituras individuais da máquina (ver processAnnouncement)
+    WireEncoding encoding(std::string_view machineId) const {
+        return machineEncodings.get(machineId);
+    }
+
+    // Registra os sensores de um anúncio {"machine_id", "encoding",
+    // "sensors": [{"sensor_id", "data_type", "data_interval"}]}, em JSON ou
+    // CBOR, e pré-aloca o estado de cada um. A codificação anunciada passa a
+    // valer para as leituras da máquina.
+    void processAnnouncement(std::string_view message) {
+        MachineAnnouncement announcement;
+        bool parsed = parseAnnouncement(message, announcement);
+        const std::string& machineId = announcement.machineId;
+        if (!parsed || machineId.empty() || machineId.find('/') != std::string::npos) {
+            std::cerr << "Invalid announcement on /sensor_monitors" << std::endl;
+            return;
+        }
+        if (announcement.encoding != "json" && announcement.encoding != "cbor") {
+            std::cerr << "Unsupported encoding for " << machineId << ": " << announcement.encoding << std::endl;
+            return;
+        }
+        machineEncodings.set(machineId, announcement.encoding == "cbor" ? WireEncoding::CBOR : WireEncoding::JSON);
+
+        for (const SensorAnnouncement& sensor : announcement.sensors) {
+            const std::string& sensorId = sensor.sensorId;
+            if (sensorId.empty() || sensorId.find('/') != std::string::npos || sensor.dataInterval <= 0) {
+                std::cerr << "Invalid sensor in announcement from " << machineId << std::endl;
+                continue;
+            }
+            if (sensor.dataType != "float") {
+                std::cerr << "Unsupported data_type for " << machineId << "/" << sensorId << std::endl;
+            }
+
+            SensorHandle handle = sensorKeys.intern(machineId + "/" + sensorId);
+            sensorStates.announce(handle, sensor.dataInterval * NANOS_PER_SECOND, currentTimestamp(), steadyNanos());
+            armInactivityTimer(handle);
+            std::cout << "REGISTRY: " << machineId << "/" << sensorId << " interval=" << sensor.dataInterval
+                      << "s encoding=" << announcement.encoding << std::endl;
+        }
+    }
+
+    // Cada sensor é medido contra o próprio período: a cada período inteiro
+    // sem leitura conta uma falta, e a partir de 3 faltas gera um alarme por
+    // período. Só os sensores cujo timer venceu são visitados; um timer que
+    // vence para um sensor que recebeu dados é só reagendado.
+    void checkInactiveSensors() {
+        const int64_t now = steadyNanos();
+        std::vector<std::pair<SensorHandle, Timestamp>> inactiveSince;
+        expiredTimers.clear();
+        inactivityTimers.advance(now, expiredTimers);
+        for (const TimerWheel::Timer& timer : expiredTimers) {
+            int64_t next = 0;
+            sensorStates.visit(timer.handle, [&](SensorData& data) {
+                if (data.armedDeadline != timer.deadline) {
+                    return; // timer obsoleto
+                }
+                int missed = (int)((now - data.lastArrival) / data.intervalNs);
+                // Se o sensor estiver inativo por 2 períodos, gerar alarme
+                if (missed >= 3 && missed != data.missed_periods) {
+                    inactiveSince.push_back({timer.handle, data.timestamp});
+                }
+                data.missed_periods = missed;
+                next = data.lastArrival + std::max(missed + 1, 3) * data.intervalNs;
+                data.armedDeadline = next;
+            });
+            if (next != 0) {
+                inactivityTimers.schedule(timer.handle, next);
+            }
+        }
+        for (const auto& inactive : inactiveSince) {
+            std::string_view key = sensorKeys.name(inactive.first);
+            std::string machineId(key.substr(0, key.find('/')));
+            std::cout << "ALARM: " + machineId + ".alarms.inactive  SINCE: " + formatTimestamp(inactive.second) << std::endl;
+            writer.addAlarm(machineId, "inactive", inactive.second);
+        }
+    }
+
+};
+
+bool isJsonSpace(char c) {
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+// Leitor direto do payload {"timestamp": "...", "value": <número>}, sem
+// alocar. O timestamp pode vir como texto ISO-8601 ou como inteiro em
+// nanossegundos. Retorna false para qualquer coisa fora desse formato
+// (chaves extras ou repetidas, strings com escape, nan/inf, JSON inválido)
+// para o chamador cair no parser SAX.
+bool parseSensorPayload(std::string_view payload, float& value, Timestamp& timestamp) {
+    size_t pos = 0;
+    auto skipSpace = [&] {
+        while (pos < payload.size() && isJsonSpace(payload[pos])) {
+            pos++;
+        }
+    };
+    auto expect = [&](char c) {
+        skipSpace();
+        if (pos < payload.size() && payload[pos] == c) {
+            pos++;
+            return true;
+        }
+        return false;
+    };
+    auto readString = [&](std::string_view& out) {
+        if (!expect('"')) {
+            return false;
+        }
+        size_t start = pos;
+        while (pos < payload.size() && payload[pos] != '"') {
+            if (payload[pos] == '\\') {
+                return false;
+            }
+            pos++;
+        }
+        if (pos >= payload.size()) {
+            return false;
+        }
+        out = payload.substr(start, pos - start);
+        pos++;
+        return true;
+    };
+
+    bool hasValue = false;
+    bool hasTimestamp = false;
+    if (!expect('{')) {
+        return false;
+    }
+    do {
+        std::string_view key;
+        if (!readString(key) || !expect(':')) {
+            return false;
+        }
+        if (key == "timestamp") {
+            if (hasTimestamp) {
+                return false;
+            }
+            skipSpace();
+            if (pos < payload.size() && payload[pos] == '"') {
+                std::string_view text;
+                if (!readString(text) || !parseTimestamp(text, timestamp)) {
+                    return false;
+                }
+            } else {
+                auto result = std::from_chars(payload.data() + pos, payload.data() + payload.size(), timestamp);
+                if (result.ec != std::errc()) {
+                    return false;
+                }
+                pos = result.ptr - payload.data();
+            }
+            hasTimestamp = true;
+        } else if (key == "value") {
+            if (hasValue) {
+                return false;
+            }
+            skipSpace();
+            // from_chars aceita "nan", "inf" e "infinity", que não são JSON
+            auto result = std::from_chars(payload.data() + pos, payload.data() + payload.size(), value);
+            if (result.ec != std::errc() || !std::isfinite(value)) {
+                return false;
+            }
+            pos = result.ptr - payload.data();
+            hasValue = true;
+        } else {
+            return false;
+        }
+    } while (expect(','));
+    if (!expect('}')) {
+        return false;
+    }
+    skipSpace();
+    return pos == payload.size() && hasValue && hasTimestamp;
+}
+
+// Caminho geral pela interface SAX do json.hpp, usado quando o leitor
+// direto recusa o payload (espaços incomuns, escapes, chaves extras). Só
+// "timestamp" e "value" do objeto de primeiro nível são lidos; o resto é
+// ignorado sem montar árvore. Chaves repetidas e valores que não cabem num
+// float finito invalidam o payload.
+class SensorPayloadSax : public json::json_sax_t {
+private:
+    enum class Field { NONE, TIMESTAMP, VALUE };
+
+    int depth = 0;
+    Field field = Field::NONE;
+    bool seenTimestamp = false;
+    bool seenValue = false;
+
+    bool number(double number) {
+        if (field == Field::VALUE) {
+            value = (float)number;
+            if (!std::isfinite(value)) {
+                error = "value out of range";
+                return false;
+            }
+            hasValue = true;
+        }
+        field = Field::NONE;
+        return true;
+    }
+
+    bool other() {
+        field = Field::NONE;
+        return true;
+    }
+
+public:
+    float value = 0.0f;
+    Timestamp timestamp = 0;
+    bool hasValue = false;
+    bool hasTimestamp = false;
+    bool badTimestamp = false;
+    std::string error;
+
+    bool null() override {
+        return other();
+    }
+
+    bool boolean(bool) override {
+        return other();
+    }
+
+    bool number_integer(number_integer_t number) override {
+        if (field == Field::TIMESTAMP) {
+            timestamp = number;
+            hasTimestamp = true;
+            field = Field::NONE;
+            return true;
+        }
+        return this->number((double)number);
+    }
+
+    bool number_unsigned(number_unsigned_t number) override {
+        if (field == Field::TIMESTAMP) {
+            timestamp = (Timestamp)number;
+            hasTimestamp = number <= (number_unsigned_t)INT64_MAX;
+            badTimestamp = !hasTimestamp;
+            field = Field::NONE;
+            return true;
+        }
+        return this->number((double)number);
+    }
+
+    bool number_float(number_float_t number, const string_t&) override {
+        return this->number(number);
+    }
+
+    bool string(string_t& text) override {
+        if (field == Field::TIMESTAMP) {
+            hasTimestamp = parseTimestamp(text, timestamp);
+            badTimestamp = !hasTimestamp;
+        }
+        return other();
+    }
+
+    bool binary(binary_t&) override {
+        return other();
+    }
+
+    bool start_object(std::size_t) override {
+        depth++;
+        return other();
+    }
 
-    if (sqlite3_exec(db, createSensorsTableSQL, 0, 0, &errorMessage) != SQLITE_OK) {
-        std::cerr << "Error creating sensor_data table: " << errorMessage << std::endl;
-        sqlite3_free(errorMessage);
-        return -1;
+    bool key(string_t& name) override {
+        field = Field::NONE;
+        if (depth == 1) {
+            bool* seen = nullptr;
+            if (name == "timestamp") {
+                field = Field::TIMESTAMP;
+                seen = &seenTimestamp;
+            } else if (name == "value") {
+                field = Field::VALUE;
+                seen = &seenValue;
+            }
+            if (seen != nullptr) {
+                if (*seen) {
+                    error = "duplicate key " + name;
+                    return false;
+                }
+                *seen = true;
+            }
+        }
+        return true;
     }
-    
-    if (sqlite3_exec(db, createAlarmsTableSQL, 0, 0, &errorMessage) != SQLITE_OK) {
-        std::cerr << "Error creating alarms table: " << errorMessage << std::endl;
-        sqlite3_free(errorMessage);
-        return -1;
+
+    bool end_object() override {
+        depth--;
+        return true;
     }
-    
-    return 0;
+
+    bool start_array(std::size_t) override {
+        depth++;
+        return other();
+    }
+
+    bool end_array() override {
+        depth--;
+        return true;
+    }
+
+    bool parse_error(std::size_t, const std::string&, const nlohmann::detail::exception& e) override {
+        error = e.what();
+        return false;
+    }
+};
+
+bool parseSensorPayloadSAX(std::string_view payload, float& value, Timestamp& timestamp) {
+    SensorPayloadSax sax;
+    if (!json::sax_parse(payload.begin(), payload.end(), &sax)) {
+        std::cerr << "Error parsing JSON: " << sax.error << std::endl;
+        return false;
+    }
+    if (!sax.hasTimestamp || !sax.hasValue) {
+        std::cerr << (sax.badTimestamp ? "Invalid timestamp in payload" : "Missing timestamp or value in payload") << std::endl;
+        return false;
+    }
+    value = sax.value;
+    timestamp = sax.timestamp;
+    return true;
 }
 
-// Estrutura para armazenar dados dos sensores
-struct SensorData {
+// Lote de leituras em uma única mensagem (SENSOR_BATCH_TOPIC):
+// {"schema_version": 1, "readings": [{"machine_id": "...", "sensor_id": "...",
+//   "timestamp": <ns desde a época ou texto ISO 8601>, "value": <número>}, ...]}
+// Leituras inválidas são ignoradas individualmente; o resto do lote segue.
+void processSensorBatch(std::string_view message, DataProcessor& processor) {
+    json root = json::parse(message.begin(), message.end(), nullptr, false);
+    if (root.is_discarded() || !root.is_object()) {
+        std::cerr << "Error parsing sensor batch" << std::endl;
+        return;
+    }
+
+    const json::const_iterator version = root.find("schema_version");
+    if (version == root.end() || !version->is_number_integer() ||
+        version->get<int64_t>() != SENSOR_BATCH_SCHEMA_VERSION) {
+        std::cerr << "Unsupported sensor batch schema_version: "
+                  << (version == root.end() ? "missing" : version->dump()) << std::endl;
+        return;
+    }
+    const json::const_iterator readings = root.find("readings");
+    if (readings == root.end() || !readings->is_array()) {
+        std::cerr << "Invalid sensor batch: missing readings" << std::endl;
+        return;
+    }
+
+    // Cada leitura passa pela mesma validação de tópico das mensagens
+    // individuais; o buffer é reaproveitado entre as leituras
+    std::string topic;
+    const json missing;
+    for (const json& reading : *readings) {
+        if (!reading.is_object()) {
+            std::cerr << "Invalid reading in sensor batch" << std::endl;
+            continue;
+        }
+        auto field = [&](const char* name) -> const json& {
+            json::const_iterator it = reading.find(name);
+            return it == reading.end() ? missing : *it;
+        };
+        const json& machineId = field("machine_id");
+        const json& sensorId = field("sensor_id");
+        const json& ts = field("timestamp");
+        const json& value = field("value");
+        if (!machineId.is_string() || !sensorId.is_string() || !value.is_number()) {
+            std::cerr << "Invalid reading in sensor batch" << std::endl;
+            continue;
+        }
+
+        Timestamp timestamp;
+        if (ts.is_number_unsigned()) {
+            // Acima de INT64_MAX o get<Timestamp>() daria a volta
+            if (ts.get<uint64_t>() > (uint64_t)INT64_MAX) {
+                std::cerr << "Invalid timestamp in sensor batch" << std::endl;
+                continue;
+            }
+            timestamp = (Timestamp)ts.get<uint64_t>();
+        } else if (ts.is_number_integer()) {
+            timestamp = ts.get<Timestamp>();
+        } else if (!ts.is_string() || !parseTimestamp(ts.get_ref<const std::string&>(), timestamp)) {
+            std::cerr << "Invalid timestamp in sensor batch" << std::endl;
+            continue;
+        }
+
+        topic.assign("/sensors/").append(machineId.get_ref<const std::string&>())
+             .append("/").append(sensorId.get_ref<const std::string&>());
+        SensorTopic sensorTopic;
+        if (!parseSensorTopic(topic, sensorTopic)) {
+            std::cerr << "Invalid sensor in batch: " << topic << std::endl;
+            continue;
+        }
+        float readingValue = value.get<float>();
+        if (!std::isfinite(readingValue)) {
+            std::cerr << "Invalid value in sensor batch: " << topic << std::endl;
+            continue;
+        }
+        processor.processSensorData(sensorTopic, readingValue, timestamp);
+    }
+}
+
+// Função para processar os dados recebidos. Cada leitura individual é lida
+// na codificação que a máquina anunciou (JSON sem anúncio); uma mensagem
+// na outra codificação é recusada. Como o anúncio não fica retido no
+// broker, um processador iniciado depois dele recusa as leituras CBOR da
+// máquina até o coletor se anunciar de novo. Lotes são sempre JSON.
+void processIncomingMessage(std::string_view topic, std::string_view message, DataProcessor& processor) {
+    if (topic == "/sensor_monitors") {
+        processor.processAnnouncement(message);
+        return;
+    }
+    if (topic == SENSOR_BATCH_TOPIC) {
+        processSensorBatch(message, processor);
+        return;
+    }
+
+    SensorTopic sensorTopic;
+    if (!parseSensorTopic(topic, sensorTopic)) {
+        return;
+    }
+
     float value;
-    std::string timestamp;
-    int missed_periods = 0;
+    Timestamp timestamp;
+    WireEncoding encoding = processor.encoding(sensorTopic.machineId);
+    if (isCborMessage(message) != (encoding == WireEncoding::CBOR)) {
+        std::cerr << "Payload on " << topic << " does not match the encoding expected for "
+                  << sensorTopic.machineId << std::endl;
+        return;
+    }
+    if (encoding == WireEncoding::CBOR) {
+        if (parseSensorPayloadCBOR(message, value, timestamp)) {
+            processor.processSensorData(sensorTopic, value, timestamp);
+        } else {
+            std::cerr << "Error parsing CBOR payload on " << topic << std::endl;
+        }
+    } else if (parseSensorPayload(message, value, timestamp) || parseSensorPayloadSAX(message, value, timestamp)) {
+        processor.processSensorData(sensorTopic, value, timestamp);
+    }
+}
+
+void processAlarms(DataProcessor& processor) {
+    processor.checkInactiveSensors();
+}
+
+// Subclasse que implementa a interface mqtt::callback (interface de retorno 
+// de chamada do cliente mqtt para processar eventos, mensagens, conexão, etc)
+class CallbackHandler : public mqtt::callback {
+private:
+    DataProcessor& processor;
+
+public:
+    CallbackHandler(DataProcessor& proc) : processor(proc) {}
+
+    // chamado automaticamente quando uma mensagem (ponteiro msg para a mensagem) é recebida
+    // Tópico e payload são lidos direto dos buffers da mensagem, sem cópia
+    void message_arrived(mqtt::const_message_ptr msg) {
+        const mqtt::binary& payload = msg->get_payload();
+        processIncomingMessage(msg->get_topic(), std::string_view(payload.data(), payload.size()), processor);
+    }
 };
 
-// Classe para gerenciar alarmes
-int insertSensorData(const std::string& machineId, const std::string& sensorId, float value, const std::string& timestamp) {
-    std::string sql = "INSERT INTO sensor_data (machine_id, sensor_id, value, timestamp) VALUES (?, ?, ?, ?);";
-    sqlite3_stmt* stmt;
-    
-    if (sqlite3_prepare_v2(db, sql.c_str(), -1, &stmt, 0) != SQLITE_OK) {
-        std::cerr << "Error preparing statement: " << sqlite3_errmsg(db) << std::endl;
+// Consultas ao banco, usadas pelo modo --query e pelo --bench-query. Cada
+// consulta é um statement preparado do statementCache, servido pela chave
+// primária de readings (sensor, timestamp_ns) ou pelo índice de tempo de
+// alarm_events, e entrega as linhas ao callback à medida que o SQLite as
+// produz, sem montar o resultado em memória.
+const std::string SELECT_SENSOR_ID_SQL =
+    "SELECT s.id FROM sensors s JOIN machines m ON m.id = s.machine WHERE m.name = ? AND s.name = ?;";
+// As leituras estão em main.readings e, com partições, em <partição>.readings
+std::string selectRangeSQL(const std::string& schema) {
+    return "SELECT timestamp_ns, value FROM " + schema + ".readings WHERE sensor = ? AND timestamp_ns BETWEEN ? AND ?"
+           " ORDER BY timestamp_ns;";
+}
+
+// Um parâmetro sem bind vale NULL: sem o filtro de sensor, vêm todos os da máquina
+std::string selectLatestSQL(const std::string& schema) {
+    return "SELECT s.name, r.timestamp_ns, r.value FROM main.sensors s JOIN main.machines m ON m.id = s.machine"
+           " JOIN " + schema + ".readings r ON r.sensor = s.id AND r.timestamp_ns ="
+           " (SELECT timestamp_ns FROM " + schema + ".readings WHERE sensor = s.id ORDER BY timestamp_ns DESC LIMIT 1)"
+           " WHERE m.name = ?1 AND (?2 IS NULL OR s.name = ?2) ORDER BY s.name;";
+}
+
+const std::string SELECT_RANGE_SQL = selectRangeSQL("main");
+const std::string SELECT_LATEST_SQL = selectLatestSQL("main");
+const std::string COUNT_SENSORS_SQL =
+    "SELECT COUNT(*) FROM sensors s JOIN machines m ON m.id = s.machine"
+    " WHERE m.name = ?1 AND (?2 IS NULL OR s.name = ?2);";
+const std::string SELECT_ALARMS_SQL =
+    "SELECT m.name, t.name, a.timestamp_ns FROM alarm_events a"
+    " JOIN machines m ON m.id = a.machine JOIN alarm_types t ON t.id = a.alarm_type"
+    " WHERE a.timestamp_ns BETWEEN ?1 AND ?2 AND (?3 IS NULL OR m.name = ?3) ORDER BY a.timestamp_ns;";
+
+// Id do sensor, sem criar a linha de dimensão (ao contrário do DimensionIds)
+sqlite3_int64 findSensor(std::string_view machineId, std::string_view sensorId) {
+    CachedStatement stmt = statementCache.get(SELECT_SENSOR_ID_SQL);
+    if (!stmt.valid()) {
         return -1;
     }
-    
-    sqlite3_bind_text(stmt, 1, machineId.c_str(), -1, SQLITE_STATIC);
-    sqlite3_bind_text(stmt, 2, sensorId.c_str(), -1, SQLITE_STATIC);
-    sqlite3_bind_double(stmt, 3, value);
-    sqlite3_bind_text(stmt, 4, timestamp.c_str(), -1, SQLITE_STATIC);
-    
-    if (sqlite3_step(stmt) != SQLITE_DONE) {
-        std::cerr << "Error executing statement: " << sqlite3_errmsg(db) << std::endl;
-        sqlite3_finalize(stmt);
+    stmt.bind(1, machineId);
+    stmt.bind(2, sensorId);
+    if (stmt.step() != SQLITE_ROW) {
+        std::cerr << "Unknown sensor " << machineId << "/" << sensorId << std::endl;
+        return -1;
+    }
+    return sqlite3_column_int64(stmt.get(), 0);
+}
+
+// Percorre as linhas de um statement já com os parâmetros ligados
+template <typename Fn>
+int streamRows(CachedStatement& stmt, Fn&& fn) {
+    int rc;
+    while ((rc = stmt.step()) == SQLITE_ROW) {
+        fn(stmt.get());
+    }
+    if (rc != SQLITE_DONE) {
+        std::cerr << "Error executing query: " << sqlite3_errmsg(db) << std::endl;
         return -1;
     }
-    
-    sqlite3_finalize(stmt);
     return 0;
 }
-int insertAlarm(const std::string& machineId, const std::string& alarmType, const std::string& timestamp) {
-    if(alarmType !="inactive"){ 
-        std::cout << "ALARM: " + MACHINE_ID + ".alarms." + alarmType + "  TIME: " + timestamp << std::endl;
+
+// fn(timestamp, valor) para cada leitura do sensor em [from, to]. Com
+// partições, só as que cruzam o período são lidas, em ordem de tempo, depois
+// das leituras anteriores ao particionamento (em main.readings).
+template <typename Fn>
+int queryRange(sqlite3_int64 sensor, Timestamp from, Timestamp to, Fn&& fn) {
+    return partitions.scan(from, to, false, [&](const std::string& schema) {
+        CachedStatement stmt = statementCache.get(selectRangeSQL(schema));
+        if (!stmt.valid()) {
+            return -1;
+        }
+        stmt.bind(1, sensor);
+        stmt.bind(2, (sqlite3_int64)from);
+        stmt.bind(3, (sqlite3_int64)to);
+        return streamRows(stmt, [&](sqlite3_stmt* row) {
+            fn(sqlite3_column_int64(row, 0), sqlite3_column_double(row, 1));
+        });
+    });
+}
+
+// fn(sensor_id, timestamp, valor) com a última leitura de cada sensor da
+// máquina (ou só do sensor pedido), em ordem de nome. As partições são
+// lidas da mais nova para a mais antiga até todos os sensores aparecerem;
+// como as janelas não se sobrepõem, a primeira leitura achada é a última.
+template <typename Fn>
+int queryLatest(std::string_view machineId, std::string_view sensorId, Fn&& fn) {
+    sqlite3_int64 expected = 0;
+    {
+        CachedStatement stmt = statementCache.get(COUNT_SENSORS_SQL);
+        if (!stmt.valid()) {
+            return -1;
+        }
+        stmt.bind(1, machineId);
+        if (!sensorId.empty()) {
+            stmt.bind(2, sensorId);
+        }
+        if (stmt.step() != SQLITE_ROW) {
+            std::cerr << "Error executing query: " << sqlite3_errmsg(db) << std::endl;
+            return -1;
+        }
+        expected = sqlite3_column_int64(stmt.get(), 0);
     }
-    std::string sql = "INSERT INTO alarms (machine_id, alarm_type, timestamp) VALUES (?, ?, ?);";
-    sqlite3_stmt* stmt;
-    
-    if (sqlite3_prepare_v2(db, sql.c_str(), -1, &stmt, 0) != SQLITE_OK) {
-        std::cerr << "Error preparing statement: " << sqlite3_errmsg(db) << std::endl;
+
+    std::map<std::string, std::pair<Timestamp, double>, std::less<>> latest;
+    int rc = partitions.scan(std::numeric_limits<Timestamp>::min(), std::numeric_limits<Timestamp>::max(), true,
+                             [&](const std::string& schema) {
+        if ((sqlite3_int64)latest.size() >= expected) {
+            return 1;
+        }
+        CachedStatement stmt = statementCache.get(selectLatestSQL(schema));
+        if (!stmt.valid()) {
+            return -1;
+        }
+        stmt.bind(1, machineId);
+        if (!sensorId.empty()) {
+            stmt.bind(2, sensorId);
+        }
+        return streamRows(stmt, [&](sqlite3_stmt* row) {
+            latest.emplace(std::string((const char*)sqlite3_column_text(row, 0), sqlite3_column_bytes(row, 0)),
+                           std::make_pair(sqlite3_column_int64(row, 1), sqlite3_column_double(row, 2)));
+        });
+    });
+    for (const auto& entry : latest) {
+        fn(std::string_view(entry.first), entry.second.first, entry.second.second);
+    }
+    return rc;
+}
+
+// fn(ReadingAggregate) por linha de um nível de rollup em [from, to]
+template <typename Fn>
+int scanRollup(const RollupLevel& level, sqlite3_int64 sensor, Timestamp from, Timestamp to, Fn&& fn) {
+    CachedStatement stmt = statementCache.get(level.selectSQL);
+    if (!stmt.valid()) {
         return -1;
     }
-    
-    sqlite3_bind_text(stmt, 1, machineId.c_str(), -1, SQLITE_STATIC);
-    sqlite3_bind_text(stmt, 2, alarmType.c_str(), -1, SQLITE_STATIC);
-    sqlite3_bind_text(stmt, 3, timestamp.c_str(), -1, SQLITE_STATIC);
-    
-    if (sqlite3_step(stmt) != SQLITE_DONE) {
-        std::cerr << "Error executing statement: " << sqlite3_errmsg(db) << std::endl;
-        sqlite3_finalize(stmt);
+    stmt.bind(1, sensor);
+    stmt.bind(2, (sqlite3_int64)from);
+    stmt.bind(3, (sqlite3_int64)to);
+    return streamRows(stmt, [&](sqlite3_stmt* row) {
+        ReadingAggregate bucket;
+        bucket.bucketStart = sqlite3_column_int64(row, 0);
+        bucket.min = sqlite3_column_double(row, 1);
+        bucket.max = sqlite3_column_double(row, 2);
+        bucket.sum = sqlite3_column_double(row, 3);
+        bucket.count = sqlite3_column_int64(row, 4);
+        bucket.lastTimestamp = sqlite3_column_int64(row, 5);
+        bucket.last = sqlite3_column_double(row, 6);
+        fn(bucket);
+    });
+}
+
+// Nível de rollup mais grosso cujo intervalo divide bucketNs (nullptr se nenhum)
+const RollupLevel* coarsestRollup(int64_t bucketNs) {
+    for (int i = ROLLUP_LEVEL_COUNT - 1; i >= 0; i--) {
+        if (bucketNs % ROLLUP_LEVELS[i].bucketNs == 0) {
+            return &ROLLUP_LEVELS[i];
+        }
+    }
+    return nullptr;
+}
+
+// fn(ReadingAggregate) por intervalo de bucketNs (alinhado à época). O
+// período é alargado para intervalos inteiros e a resposta vem do rollup
+// mais grosso cujo intervalo divide bucketNs; se nenhum divide (ou com
+// useRollups = false), das leituras brutas. As linhas chegam em ordem de
+// tempo pela chave primária, então cada intervalo é contíguo e é fechado
+// aqui, em uma passada, sem GROUP BY (que ordenaria tudo de novo em uma
+// B-tree temporária).
+template <typename Fn>
+int queryAggregate(sqlite3_int64 sensor, Timestamp from, Timestamp to, int64_t bucketNs, Fn&& fn,
+                   bool useRollups = true) {
+    from = bucketStartOf(from, bucketNs);
+    to = bucketStartOf(to, bucketNs) + bucketNs - 1;
+    ReadingAggregate current;
+    auto add = [&](const ReadingAggregate& part) {
+        Timestamp bucketStart = bucketStartOf(part.bucketStart, bucketNs);
+        if (current.count > 0 && bucketStart != current.bucketStart) {
+            fn(current);
+            current = ReadingAggregate();
+        }
+        current.bucketStart = bucketStart;
+        current.merge(part);
+    };
+    const RollupLevel* level = useRollups ? coarsestRollup(bucketNs) : nullptr;
+    int rc;
+    if (level) {
+        rc = scanRollup(*level, sensor, from, to, add);
+    } else {
+        rc = queryRange(sensor, from, to, [&](Timestamp timestamp, double value) {
+            ReadingAggregate reading;
+            reading.bucketStart = timestamp;
+            reading.add(timestamp, value);
+            add(reading);
+        });
+    }
+    if (rc == 0 && current.count > 0) {
+        fn(current);
+    }
+    return rc;
+}
+
+// Agregado único de [from, to], sem alargar o período: os intervalos
+// inteiros de um nível vêm do rollup dele, e só as pontas descem para os
+// níveis mais finos e, por fim (level < 0), para as leituras brutas
+int aggregateSpan(sqlite3_int64 sensor, Timestamp from, Timestamp to, int level, ReadingAggregate& total) {
+    if (from > to) {
+        return 0;
+    }
+    if (level < 0) {
+        return queryRange(sensor, from, to, [&](Timestamp timestamp, double value) {
+            total.add(timestamp, value);
+        });
+    }
+    const int64_t bucketNs = ROLLUP_LEVELS[level].bucketNs;
+    const Timestamp first = bucketStartOf(from + bucketNs - 1, bucketNs);
+    const Timestamp end = bucketStartOf(to + 1, bucketNs);
+    if (first >= end) {
+        return aggregateSpan(sensor, from, to, level - 1, total);
+    }
+    if (aggregateSpan(sensor, from, first - 1, level - 1, total) != 0 ||
+        scanRollup(ROLLUP_LEVELS[level], sensor, first, end - 1, [&](const ReadingAggregate& bucket) {
+            total.merge(bucket);
+        }) != 0) {
         return -1;
     }
-    
-    sqlite3_finalize(stmt);
-    return 0;
+    return aggregateSpan(sensor, end, to, level - 1, total);
 }
-// Processamento de dados dos sensores
-class DataProcessor {
-private:
-    mqtt::async_client& client;
-    std::map<std::string, SensorData> sensorDataMap;
-    std::mutex dataMutex;
 
-public:
-    DataProcessor(mqtt::async_client& mqttClient) : client(mqttClient) {}
+// fn(machine_id, alarm_type, timestamp) para os alarmes em [from, to]
+template <typename Fn>
+int queryAlarms(Timestamp from, Timestamp to, std::string_view machineId, Fn&& fn) {
+    CachedStatement stmt = statementCache.get(SELECT_ALARMS_SQL);
+    if (!stmt.valid()) {
+        return -1;
+    }
+    stmt.bind(1, (sqlite3_int64)from);
+    stmt.bind(2, (sqlite3_int64)to);
+    if (!machineId.empty()) {
+        stmt.bind(3, machineId);
+    }
+    return streamRows(stmt, [&](sqlite3_stmt* row) {
+        fn(std::string_view((const char*)sqlite3_column_text(row, 0), sqlite3_column_bytes(row, 0)),
+           std::string_view((const char*)sqlite3_column_text(row, 1), sqlite3_column_bytes(row, 1)),
+           sqlite3_column_int64(row, 2));
+    });
+}
 
-    // Função para processar os dados de temperatura e umidade
-    void processSensorData(const std::string& sensorId, float value, const std::string& timestamp) {
+// Instante de uma consulta: ISO-8601, "now" ou relativo a agora ("-1h")
+bool parseQueryTime(std::string_view text, Timestamp now, Timestamp& out) {
+    int64_t offset;
+    if (text == "now") {
+        out = now;
+    } else if (!text.empty() && text[0] == '-' && parseDuration(text.substr(1), offset)) {
+        out = now - offset;
+    } else {
+        return parseTimestamp(text, out);
+    }
+    return true;
+}
 
-        std::lock_guard<std::mutex> lock(dataMutex);
+// Linha de saída do --query: campos separados por tab, escrita no buffer do
+// stdio à medida que as linhas chegam
+class TsvLine {
+private:
+    std::string line;
 
-        // Verifica se o sensor já existe, caso contrário, cria um novo
-        if (sensorDataMap.find(sensorId) == sensorDataMap.end()) {
-            sensorDataMap[sensorId] = {value, timestamp};
-            return;
+    void separate() {
+        if (!line.empty()) {
+            line += '\t';
         }
+    }
 
-        SensorData& data = sensorDataMap[sensorId];
-        // Atualiza os dados do sensor
-        data.value = value;
-        data.timestamp = timestamp;
-        data.missed_periods = 0;  // Reset missed periods ao receber novo dado
+public:
+    TsvLine& text(std::string_view value) {
+        separate();
+        line += value;
+        return *this;
+    }
 
-        insertSensorData(MACHINE_ID, sensorId, value, timestamp);
- 
-        if (sensorId == "sensor_temperature") {
-            if (value > 20.0f && value < 26.0f) {
-                insertAlarm(MACHINE_ID, "good_temperature", timestamp);
-            }
-            if (value < 20.0f) {
-                insertAlarm(MACHINE_ID, "low_temperature", timestamp);
-            }
-            if (value > 26.0f) {
-                insertAlarm(MACHINE_ID, "high_temperature", timestamp);
-            }
-        } else if (sensorId == "sensor_humidity") {
-            if (value > 40.0f && value < 60.0f) {
-                insertAlarm(MACHINE_ID, "good_humidity", timestamp);
-            }
-            if (value < 40.0f) {
-                insertAlarm(MACHINE_ID, "low_humidity", timestamp);
-            }
-            if (value > 60.0f) {
-                insertAlarm(MACHINE_ID, "high_humidity", timestamp);
-            }
-        }
-        
+    // ISO-8601 e nanossegundos, para leitura humana e sem perder precisão
+    TsvLine& timestamp(Timestamp value) {
+        char buffer[32];
+        text(std::string_view(buffer, formatTimestamp(value, buffer)));
+        auto result = std::to_chars(buffer, buffer + sizeof(buffer), value);
+        return text(std::string_view(buffer, result.ptr - buffer));
     }
 
-    void checkInactiveSensors() {
-        std::lock_guard<std::mutex> lock(dataMutex);
-        for (auto& entry : sensorDataMap) {
-            SensorData& data = entry.second;
-            data.missed_periods++;
+    // Os valores chegaram como float32: imprime a menor forma que volta ao mesmo float
+    TsvLine& number(double value) {
+        char buffer[32];
+        auto result = std::to_chars(buffer, buffer + sizeof(buffer), (float)value);
+        return text(std::string_view(buffer, result.ptr - buffer));
+    }
 
-            // Se o sensor estiver inativo por 2 períodos, gerar alarme
-            if (data.missed_periods >= 3) {
-                std::cout << "ALARM: " + MACHINE_ID + ".alarms.inactive  SINCE: " + data.timestamp << std::endl;
-                insertAlarm(MACHINE_ID, "inactive", data.timestamp);
-            }
-        }   
+    TsvLine& integer(int64_t value) {
+        char buffer[24];
+        auto result = std::to_chars(buffer, buffer + sizeof(buffer), value);
+        return text(std::string_view(buffer, result.ptr - buffer));
     }
 
+    void end() {
+        line += '\n';
+        std::fwrite(line.data(), 1, line.size(), stdout);
+        line.clear();
+    }
 };
 
-// Função para processar os dados JSON recebidos
-void processIncomingMessage(std::string& topic, const std::string& message, DataProcessor& processor) {
-    Json::CharReaderBuilder reader;
-    Json::Value root;
-    std::istringstream s(message);
-    std::string errs;
-    std::string sensorId;
+int printQueryUsage() {
+    std::cerr << "Usage: data_processor --query latest <machine> [sensor]\n"
+                 "       data_processor --query range <machine> <sensor> <from> <to>\n"
+                 "       data_processor --query aggregate <machine> <sensor> <from> <to> [bucket]\n"
+                 "       data_processor --query alarms <from> <to> [machine]\n"
+                 "Options: --db=<path> (default " << DATABASE_PATH << ")\n"
+                 "Times: ISO-8601 (2025-01-31T00:00:00Z), now or relative (-15m, -1h, -7d);"
+                 " buckets: 30s, 15m, 1h, 1d, 1w\n"
+                 "With a bucket, <from> and <to> are widened to whole buckets" << std::endl;
+    return -1;
+}
+
+// Modo --query: abre o banco só para leitura (pode rodar junto com o
+// processador, graças ao WAL) e imprime o resultado em TSV com cabeçalho
+int runQuery(int argc, char* argv[]) {
+    std::string databasePath = DATABASE_PATH;
+    std::vector<std::string> args;
+    for (int i = 2; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg.rfind("--db=", 0) == 0) {
+            databasePath = arg.substr(5);
+        } else {
+            args.push_back(arg);
+        }
+    }
+    if (args.empty()) {
+        return printQueryUsage();
+    }
 
-    if(topic.find("sensor_temperature")!=std::string::npos){
-        sensorId = "sensor_temperature";
+    const std::string& kind = args[0];
+    const Timestamp now = currentTimestamp();
+    Timestamp from = 0;
+    Timestamp to = 0;
+    int64_t bucketNs = 0;
+    bool valid = false;
+    if (kind == "latest") {
+        valid = args.size() == 2 || args.size() == 3;
+    } else if (kind == "range" || kind == "aggregate") {
+        valid = (args.size() == 5 || (kind == "aggregate" && args.size() == 6)) &&
+                parseQueryTime(args[3], now, from) && parseQueryTime(args[4], now, to) &&
+                (args.size() == 5 || parseDuration(args[5], bucketNs));
+    } else if (kind == "alarms") {
+        valid = (args.size() == 3 || args.size() == 4) &&
+                parseQueryTime(args[1], now, from) && parseQueryTime(args[2], now, to);
     }
-    if(topic.find("sensor_humidity")!=std::string::npos){
-        sensorId = "sensor_humidity";
+    if (!valid) {
+        return printQueryUsage();
+    }
+
+    if (sqlite3_open_v2(databasePath.c_str(), &db, SQLITE_OPEN_READONLY, nullptr) != SQLITE_OK) {
+        std::cerr << "Error opening SQLite database: " << sqlite3_errmsg(db) << std::endl;
+        sqlite3_close(db);
+        return -1;
+    }
+    sqlite3_busy_timeout(db, BUSY_TIMEOUT_MS);
+    if (partitions.open(databasePath, 0) != 0) {
+        sqlite3_close(db);
+        return -1;
     }
-    
-    if (Json::parseFromStream(reader, s, &root, &errs)) {
-        float value = root["value"].asFloat();
-        std::string timestamp = root["timestamp"].asString();
 
-        // Processa os dados do sensor
-        if(sensorId.size()> 3) processor.processSensorData(sensorId, value, timestamp);
+    TsvLine out;
+    int rc = -1;
+    if (kind == "latest") {
+        out.text("sensor_id").text("timestamp").text("timestamp_ns").text("value").end();
+        rc = queryLatest(args[1], args.size() == 3 ? args[2] : "", [&](std::string_view sensorId, Timestamp timestamp, double value) {
+            out.text(sensorId).timestamp(timestamp).number(value).end();
+        });
+    } else if (kind == "range") {
+        sqlite3_int64 sensor = findSensor(args[1], args[2]);
+        if (sensor >= 0) {
+            out.text("timestamp").text("timestamp_ns").text("value").end();
+            rc = queryRange(sensor, from, to, [&](Timestamp timestamp, double value) {
+                out.timestamp(timestamp).number(value).end();
+            });
+        }
+    } else if (kind == "aggregate") {
+        sqlite3_int64 sensor = findSensor(args[1], args[2]);
+        if (sensor >= 0) {
+            auto print = [&](const ReadingAggregate& aggregate) {
+                out.timestamp(aggregate.bucketStart).number(aggregate.min).number(aggregate.max)
+                    .number(aggregate.avg()).integer(aggregate.count).number(aggregate.last).end();
+            };
+            out.text("bucket").text("bucket_ns").text("min").text("max").text("avg").text("count").text("last").end();
+            if (bucketNs > 0) {
+                rc = queryAggregate(sensor, from, to, bucketNs, print);
+            } else {
+                // Sem intervalo, um único grupo cobrindo exatamente [from, to]
+                ReadingAggregate total;
+                total.bucketStart = from;
+                rc = aggregateSpan(sensor, from, to, ROLLUP_LEVEL_COUNT - 1, total);
+                if (rc == 0 && total.count > 0) {
+                    print(total);
+                }
+            }
+        }
     } else {
-        std::cerr << "Error parsing JSON: " << errs << std::endl;
+        out.text("machine_id").text("alarm_type").text("timestamp").text("timestamp_ns").end();
+        rc = queryAlarms(from, to, args.size() == 4 ? args[3] : "", [&](std::string_view machineId, std::string_view alarmType, Timestamp timestamp) {
+            out.text(machineId).text(alarmType).timestamp(timestamp).end();
+        });
     }
-    
+    std::fflush(stdout);
+
+    statementCache.clear();
+    partitions.clear();
+    sqlite3_close(db);
+    return rc;
 }
 
-void processAlarms(DataProcessor& processor) {
-    processor.checkInactiveSensors();
+// Copia as leituras de um banco SQLite existente para o armazenamento
+// colunar. Lê readings na ordem da chave primária (sensor, tempo), que já
+// entrega cada série inteira e ordenada, sem ordenar a tabela. O diretório
+// precisa estar vazio para que uma segunda importação não duplique as
+// leituras.
+int importColumns(const std::string& databasePath, const std::string& directory) {
+    std::error_code error;
+    if (std::filesystem::exists(directory, error) && !std::filesystem::is_empty(directory, error)) {
+        std::cerr << "Column store " << directory << " is not empty, refusing to import" << std::endl;
+        return -1;
+    }
+    if (sqlite3_open(databasePath.c_str(), &db) != SQLITE_OK) {
+        std::cerr << "Error opening SQLite database: " << sqlite3_errmsg(db) << std::endl;
+        return -1;
+    }
+    sqlite3_busy_timeout(db, BUSY_TIMEOUT_MS);
+    // Bancos do esquema antigo são migrados antes
+    if (createTables() != 0) {
+        sqlite3_close(db);
+        return -1;
+    }
+
+    ColumnStore columns(directory);
+    if (columns.open() != 0) {
+        sqlite3_close(db);
+        return -1;
+    }
+    sqlite3_stmt* stmt;
+    const char* sql = "SELECT m.name, s.name, r.value, r.timestamp_ns FROM readings r"
+                      " JOIN sensors s ON s.id = r.sensor JOIN machines m ON m.id = s.machine"
+                      " ORDER BY r.sensor, r.timestamp_ns;";
+    if (sqlite3_prepare_v2(db, sql, -1, &stmt, 0) != SQLITE_OK) {
+        std::cerr << "Error preparing statement: " << sqlite3_errmsg(db) << std::endl;
+        sqlite3_close(db);
+        return -1;
+    }
+    // Leituras que a série já tem (p.ex. um segundo import) são recusadas
+    // pelo ColumnStore e não contam
+    uint64_t imported = 0;
+    int rc;
+    while ((rc = sqlite3_step(stmt)) == SQLITE_ROW) {
+        const char* machineId = (const char*)sqlite3_column_text(stmt, 0);
+        const char* sensorId = (const char*)sqlite3_column_text(stmt, 1);
+        int appended = columns.append(machineId, sensorId, sqlite3_column_int64(stmt, 3),
+                                      (float)sqlite3_column_double(stmt, 2));
+        if (appended < 0) {
+            rc = SQLITE_ERROR;
+            break;
+        }
+        imported += appended == 0;
+    }
+    if (rc != SQLITE_DONE) {
+        std::cerr << "Error importing readings: " << sqlite3_errmsg(db) << std::endl;
+    }
+    sqlite3_finalize(stmt);
+    columns.close();
+    statementCache.clear();
+    dimensionIds.clear();
+    sqlite3_close(db);
+    if (rc != SQLITE_DONE) {
+        return -1;
+    }
+
+    std::cout << "Imported " << imported << " readings: "
+              << std::filesystem::file_size(databasePath, error) << " bytes in " << databasePath << ", "
+              << columns.diskBytes() << " bytes in " << directory << std::endl;
+    return 0;
 }
 
-// Subclasse que implementa a interface mqtt::callback (interface de retorno 
-// de chamada do cliente mqtt para processar eventos, mensagens, conexão, etc)
-class CallbackHandler : public mqtt::callback {
-private:
-    DataProcessor& processor;
+void printStorageStats(const StorageStats& stats) {
+    std::cout << "STORAGE: queue=" << stats.queueDepth << "/" << stats.queueCapacity
+              << " enqueued=" << stats.enqueued << " committed=" << stats.committed
+              << " dropped=" << stats.dropped << " spilled=" << stats.spilled
+              << " column_pending=" << stats.columnPending << std::endl;
+}
 
-public:
-    CallbackHandler(DataProcessor& proc) : processor(proc) {}
+// Os benchmarks (bench/processor_bench.cpp) incluem este arquivo sem o main
+#ifndef DATA_PROCESSOR_NO_MAIN
+void handleSignal(int) {
+    keepRunning = false;
+}
 
-    // chamado automaticamente quando uma mensagem (ponteiro msg para a mensagem) é recebida
-    void message_arrived(mqtt::const_message_ptr msg) {
+int main(int argc, char* argv[]) {
+    if (argc > 1 && std::string(argv[1]) == "--query") {
+        return runQuery(argc, argv);
+    }
+    if (argc > 1 && std::string(argv[1]) == "--import-columns") {
+        return importColumns(argc > 2 ? argv[2] : DATABASE_PATH, COLUMN_STORE_DIR);
+    }
 
-        std::string topic = msg->get_topic();
-        std::string message = msg->get_payload_str();
-        processIncomingMessage(topic, message, processor);   
+    BackpressurePolicy backpressure = BackpressurePolicy::BLOCK;
+    StorageProfile storageProfile = StorageProfile::TUNED;
+    StorageEngine storageEngine = StorageEngine::SQLITE;
+    RetentionPolicy retention;
+    int64_t partitionWindow = 0;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg.rfind("--backpressure=", 0) == 0) {
+            if (!parseBackpressurePolicy(arg.substr(15), backpressure)) {
+                std::cerr << "Unknown backpressure policy: " << arg.substr(15)
+                          << " (use block, drop-oldest or spill)" << std::endl;
+                return -1;
+            }
+        } else if (arg.rfind("--storage-profile=", 0) == 0) {
+            if (!parseStorageProfile(arg.substr(18), storageProfile)) {
+                std::cerr << "Unknown storage profile: " << arg.substr(18)
+                          << " (use default or tuned)" << std::endl;
+                return -1;
+            }
+        } else if (arg.rfind("--storage-engine=", 0) == 0) {
+            if (!parseStorageEngine(arg.substr(17), storageEngine)) {
+                std::cerr << "Unknown storage engine: " << arg.substr(17)
+                          << " (use sqlite, columnar or both)" << std::endl;
+                return -1;
+            }
+        } else if (arg.rfind("--retention=", 0) == 0) {
+            if (!parseRetention(arg.substr(12), retention)) {
+                std::cerr << "Invalid retention: " << arg.substr(12) << " (use readings, rollups_1m, rollups_1h,"
+                          << " rollups_1d, alarms or <machine_id>/<sensor_id>, e.g. readings=30d)" << std::endl;
+                return -1;
+            }
+        } else if (arg.rfind("--partition=", 0) == 0) {
+            // Os arquivos são nomeados pelo segundo de início da janela
+            if (!parseDuration(arg.substr(12), partitionWindow) || partitionWindow < 60 * NANOS_PER_SECOND) {
+                std::cerr << "Invalid partition window: " << arg.substr(12) << " (use 1m or more, e.g. 1d)" << std::endl;
+                return -1;
+            }
+        }
     }
-};
 
-int main(int argc, char* argv[]) {
     // abrir/criar um arquivo de banco de dados 
-    if (sqlite3_open("sensor_data.db", &db) != SQLITE_OK) {
+    if (sqlite3_open(DATABASE_PATH.c_str(), &db) != SQLITE_OK) {
         std::cerr << "Error opening SQLite database: " << sqlite3_errmsg(db) << std::endl;
         return -1;
     }
 
-    if (createTables() != 0) {
+    if (configureStorage(storageProfile) != 0 || createTables() != 0 || dimensionIds.load() != 0 ||
+        partitions.open(DATABASE_PATH, partitionWindow) != 0) {
+        return -1;
+    }
+
+    CheckpointScheduler checkpointer(DATABASE_PATH, std::chrono::milliseconds(CHECKPOINT_INTERVAL_MS));
+    if (storageProfile == StorageProfile::TUNED && checkpointer.start() != 0) {
         return -1;
     }
+
+    RetentionCompactor compactor(DATABASE_PATH, retention, std::chrono::milliseconds(RETENTION_INTERVAL_MS));
+    if (!retention.empty() && compactor.start() != 0) {
+        return -1;
+    }
+
+    std::unique_ptr<ColumnStore> columns;
+    if (storageEngine != StorageEngine::SQLITE) {
+        columns = std::make_unique<ColumnStore>(COLUMN_STORE_DIR);
+        if (columns->open() != 0) {
+            return -1;
+        }
+    }
     
     mqtt::async_client client(SERVER_ADDRESS, CLIENT_ID);
     mqtt::connect_options connOpts;
     mqtt::token_ptr conntok = client.connect(connOpts);
     conntok->wait();
-    DataProcessor processor(client);
+    BatchWriter writer(BATCH_SIZE, std::chrono::milliseconds(BATCH_MAX_LATENCY_MS), backpressure,
+                       STORAGE_QUEUE_CAPACITY, "sensor_data.spill", columns.get(),
+                       storageEngine != StorageEngine::COLUMNAR);
+    DataProcessor processor(client, writer);
 
     CallbackHandler callbackHandler(processor);
 
     client.set_callback(callbackHandler);
 
     client.subscribe("/sensor_monitors", 1)->wait();
-    client.subscribe("/sensors/" + MACHINE_ID + "/sensor_temperature", 1)->wait();
-    client.subscribe("/sensors/" + MACHINE_ID + "/sensor_humidity", 1)->wait();
+    // Um único processador atende todas as máquinas e sensores
+    client.subscribe("/sensors/+/+", 1)->wait();
+    client.subscribe(SENSOR_BATCH_TOPIC, 1)->wait();
 
-    while (true) {
+    std::signal(SIGINT, handleSignal);
+    std::signal(SIGTERM, handleSignal);
+
+    // A TimerWheel avança a cada TIMER_TICK_MS; os contadores do storage
+    // seguem a cada DATA_INTERVAL
+    const int ticksPerStats = DATA_INTERVAL * 1000 / TIMER_TICK_MS;
+    int tick = 0;
+    while (keepRunning) {
         processAlarms(processor);
-        std::this_thread::sleep_for(std::chrono::seconds(DATA_INTERVAL));
+        if (tick++ % ticksPerStats == 0) {
+            printStorageStats(writer.stats());
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(TIMER_TICK_MS));
     }
 
-    sqlite3_close(db);
+    // Para de receber mensagens antes de gravar o último lote
     client.disconnect()->wait();
+    writer.stop();
+    if (columns) {
+        columns->close();
+    }
+    compactor.stop();
+    checkpointer.stop();
+    statementCache.clear();
+    dimensionIds.clear();
+    partitions.clear();
+    sqlite3_close(db);
 
     return 0;
-}
\ No newline at end of file
+}
+#endif // DATA_PROCESSOR_NO_MAIN